@@ -0,0 +1,90 @@
+/**
+ * @file aggregator.h
+ * @brief Modo de federación: agrega las métricas de varios agentes en una sola exposición.
+ *
+ * Todos los agentes de "upstreams" se scrapean en paralelo desde un único hilo, con
+ * sockets no bloqueantes y un plazo de "upstream_timeout_ms" por agente. Las familias de
+ * todos ellos se fusionan en el formato de texto de Prometheus, agregando a cada muestra
+ * la etiqueta instance="host:puerto", y se suman las series aggregate_upstream_up y
+ * aggregate_upstream_scrape_duration_seconds de cada agente.
+ *
+ * Las muestras de una familia que un agente expone en varios bloques no contiguos se
+ * fusionan todas bajo el HELP y el TYPE de su primer bloque. Una etiqueta instance que ya
+ * traiga la muestra se renombra a exported_instance. Las
+ * familias que superan AGGREGATE_MAX_FAMILIES y las que declaran un TYPE distinto del
+ * fusionado (el del primer agente que las expone) se descartan y se cuentan por agente en
+ * aggregate_upstream_dropped_families y aggregate_upstream_type_conflicts.
+ *
+ * Las direcciones se resuelven acá y no al cargar la configuración: un agente que no se
+ * puede resolver no recibe scrapes (su aggregate_upstream_up vale 0), se cuenta en
+ * aggregate_unresolved_upstreams y se vuelve a intentar cada AGGREGATE_RESOLVE_RETRY_S
+ * segundos. Las resueltas se renuevan cada AGGREGATE_RESOLVE_TTL_S segundos y también tras
+ * un scrape fallido, por si el agente cambió de dirección. getaddrinfo() bloquea el hilo de
+ * la actualización mientras resuelve, de ahí el mínimo entre intentos.
+ *
+ * La exposición fusionada queda en caché: los scrapes concurrentes comparten una misma
+ * actualización y los que llegan antes de "scrape_min_age_ms" reutilizan la anterior.
+ */
+
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include "config.h"
+#include <stddef.h>
+
+/**
+ * @brief Tamaño máximo de la respuesta de un agente, en bytes.
+ */
+#define AGGREGATE_RESPONSE_MAX (1024 * 1024)
+
+/**
+ * @brief Cantidad máxima de familias distintas entre todos los agentes.
+ */
+#define AGGREGATE_MAX_FAMILIES 128
+
+/**
+ * @brief Segundos entre dos resoluciones de un agente que se pudo resolver y responde.
+ */
+#define AGGREGATE_RESOLVE_TTL_S 300
+
+/**
+ * @brief Segundos mínimos entre dos intentos de resolver un agente que no se pudo resolver
+ * o cuyo último scrape falló.
+ */
+#define AGGREGATE_RESOLVE_RETRY_S 10
+
+/**
+ * @brief Cantidad de exposiciones fusionadas que pueden estar enviándose a la vez, más la
+ * que se está construyendo.
+ */
+#define AGGREGATE_SNAPSHOTS 8
+
+/**
+ * @brief Actualiza la exposición fusionada, salvo que no haga falta.
+ *
+ * Si hay una actualización en curso, espera a que termine. Si la última terminó hace
+ * menos de @p min_age_ms milisegundos, no hace nada.
+ *
+ * @param config Configuración con los agentes a scrapear.
+ * @param min_age_ms Antigüedad mínima de la exposición para volver a scrapear.
+ */
+void aggregate_refresh(const monitor_config_t* config, int min_age_ms);
+
+/**
+ * @brief Obtiene la última exposición fusionada.
+ *
+ * Debe devolverse con aggregate_release(), aunque mientras tanto se publique otra.
+ *
+ * @param[out] length Bytes de la exposición.
+ * @return Exposición en formato de texto, o NULL si todavía no hay ninguna.
+ */
+char* aggregate_acquire(size_t* length);
+
+/**
+ * @brief Devuelve una exposición obtenida con aggregate_acquire().
+ *
+ * @param data Exposición a devolver.
+ */
+void aggregate_release(void* data);
+
+#endif // AGGREGATOR_H
@@ -0,0 +1,36 @@
+/**
+ * @file alloc_check.h
+ * @brief Contador de asignaciones de memoria mediante un interpositor de malloc.
+ *
+ * Sólo se compila en el binario de verificación (`make alloc_check`, con ALLOC_CHECK
+ * definido), que comprueba que el régimen estable no asigna memoria dinámica.
+ */
+
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+#include <stddef.h>
+
+/**
+ * @brief Cantidad de ciclos de recolección y scrapes previos a la medición.
+ */
+#define ALLOC_CHECK_WARMUP 3
+
+/**
+ * @brief Cantidad de ciclos de recolección y scrapes medidos.
+ */
+#define ALLOC_CHECK_ROUNDS 100
+
+/**
+ * @brief Pone en cero el contador y empieza a contar asignaciones.
+ */
+void alloc_check_start();
+
+/**
+ * @brief Deja de contar asignaciones.
+ *
+ * @return Cantidad de llamadas a malloc, calloc, realloc y afines desde alloc_check_start().
+ */
+size_t alloc_check_stop();
+
+#endif // ALLOC_CHECK_H
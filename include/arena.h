@@ -0,0 +1,82 @@
+/**
+ * @file arena.h
+ * @brief Arena de memoria lineal para datos transitorios de cada ciclo de recolección.
+ *
+ * La arena reserva su memoria una sola vez; las asignaciones avanzan un puntero y se
+ * liberan todas juntas con arena_reset(). En régimen estable no se llama a malloc/free.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Alineación de las asignaciones hechas con arena_alloc().
+ */
+#define ARENA_ALIGNMENT 16
+
+/**
+ * @brief Arena de memoria lineal.
+ */
+typedef struct
+{
+    char* base;        /**< Memoria reservada. */
+    size_t capacity;   /**< Tamaño de la memoria reservada. */
+    size_t used;       /**< Bytes en uso desde el último reset. */
+    size_t high_water; /**< Máximo de bytes usados desde la creación. */
+} arena_t;
+
+/**
+ * @brief Reserva la memoria de la arena.
+ *
+ * @param arena Arena a inicializar.
+ * @param capacity Tamaño en bytes.
+ * @return 0 en caso de éxito, o -1 si no hay memoria.
+ */
+int arena_init(arena_t* arena, size_t capacity);
+
+/**
+ * @brief Libera la memoria de la arena.
+ *
+ * @param arena Arena a destruir.
+ */
+void arena_destroy(arena_t* arena);
+
+/**
+ * @brief Asigna un bloque alineado a ARENA_ALIGNMENT.
+ *
+ * @param arena Arena de la que asignar.
+ * @param size Tamaño en bytes.
+ * @return Puntero al bloque, o NULL si la arena no tiene espacio suficiente.
+ */
+void* arena_alloc(arena_t* arena, size_t size);
+
+/**
+ * @brief Devuelve el espacio libre restante sin asignarlo.
+ *
+ * Útil para leer datos de tamaño desconocido directamente en la arena; luego se
+ * confirma la cantidad usada con arena_commit().
+ *
+ * @param arena Arena.
+ * @param[out] available Bytes libres a partir del puntero devuelto.
+ * @return Puntero al comienzo del espacio libre.
+ */
+char* arena_reserve(arena_t* arena, size_t* available);
+
+/**
+ * @brief Confirma como usados los primeros @p size bytes devueltos por arena_reserve().
+ *
+ * @param arena Arena.
+ * @param size Bytes usados.
+ */
+void arena_commit(arena_t* arena, size_t size);
+
+/**
+ * @brief Libera todas las asignaciones de la arena, conservando su memoria.
+ *
+ * @param arena Arena a reiniciar.
+ */
+void arena_reset(arena_t* arena);
+
+#endif // ARENA_H
@@ -0,0 +1,73 @@
+/**
+ * @file collector.h
+ * @brief Ejecución de los ciclos de recolección, periódicos o a demanda de un scrape.
+ *
+ * Los ciclos nunca se ejecutan en paralelo: un pedido que llega mientras hay un ciclo
+ * en curso espera a que termine y usa su resultado, y un pedido que llega antes de que
+ * el último ciclo alcance la antigüedad mínima reutiliza los valores ya publicados.
+ *
+ * En modo periódico cada grupo tiene su propio vencimiento. Con "adaptive" habilitado
+ * el período de un grupo se acorta mientras sus valores cambian rápido y se alarga hacia
+ * "adaptive_max_ms" cuando se estabilizan; la frecuencia efectiva se expone en
+ * collector_sample_rate_hertz{group="..."}.
+ */
+
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include "config.h"
+
+/**
+ * @brief Pausa, en milisegundos, entre las lecturas de referencia y la primera recolección.
+ *
+ * Alcanza para las tasas de /proc/schedstat, que cuentan nanosegundos; el uso de CPU no se
+ * espera (ver CPU_USAGE_MIN_JIFFIES), de modo que el arranque no depende de la cantidad de CPUs.
+ */
+#define COLLECTOR_PRIME_DELAY_MS 10
+
+/**
+ * @brief Aplica una nueva configuración a las métricas expuestas (ver reconcile_metrics()).
+ *
+ * Espera a que termine el ciclo en curso y no deja empezar otro hasta terminar, de modo que
+ * ningún ciclo lea descriptores de perf o del conector de procesos mientras se cierran o se
+ * reabren.
+ *
+ * @param config Configuración a aplicar.
+ */
+void reconcile_collection(const monitor_config_t* config);
+
+/**
+ * @brief Ejecuta un ciclo de recolección de los grupos habilitados, salvo que no haga falta.
+ *
+ * Si hay un ciclo en curso, espera a que termine en lugar de iniciar otro. Si el último
+ * ciclo terminó hace menos de @p min_age_ms milisegundos, no hace nada.
+ *
+ * @param min_age_ms Antigüedad mínima de los valores publicados para volver a recolectar
+ *                   (0 recolecta siempre que no haya un ciclo en curso).
+ */
+void collect_metrics(int min_age_ms);
+
+/**
+ * @brief Recolecta los grupos habilitados cuyo período venció y reprograma sus vencimientos.
+ *
+ * Sin "adaptive" todos los grupos vencen cada "interval" segundos, como en el modo
+ * periódico tradicional.
+ *
+ * @return Milisegundos hasta el próximo vencimiento.
+ */
+int collect_scheduled_metrics();
+
+/**
+ * @brief Toma la primera muestra válida de todos los grupos habilitados.
+ *
+ * Las métricas que se calculan entre dos lecturas (el uso de CPU y las tasas de
+ * /proc/schedstat) toman primero su lectura de referencia y, COLLECTOR_PRIME_DELAY_MS
+ * milisegundos después, se recolectan todos los grupos. El uso de CPU no se expone hasta que
+ * una muestra abarque CPU_USAGE_MIN_JIFFIES jiffies: con una o dos CPUs eso lleva más de
+ * 100 ms, y bloquear el arranque hasta entonces superaría el objetivo de arranque.
+ * En modo periódico esa recolección ya cuenta como la primera del calendario, de modo que
+ * el bucle principal no vuelve a recolectar enseguida sobre un intervalo casi nulo.
+ */
+void prime_metrics();
+
+#endif // COLLECTOR_H
@@ -0,0 +1,261 @@
+/**
+ * @file config.h
+ * @brief Configuración inmutable del agente, con recarga atómica desde un archivo JSON.
+ *
+ * La configuración se parsea y valida completa en un objeto nuevo; sólo si es válida
+ * se publica reemplazando a la anterior con un único intercambio de puntero. Los lectores
+ * nunca ven una configuración a medio aplicar.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/**
+ * @brief Intervalo por defecto entre actualizaciones de métricas, en segundos.
+ */
+#define CONFIG_DEFAULT_INTERVAL 5
+
+/**
+ * @brief Intervalo máximo aceptado en el archivo de configuración, en segundos.
+ */
+#define CONFIG_MAX_INTERVAL 3600
+
+/**
+ * @brief Antigüedad mínima máxima aceptada para reutilizar valores en un scrape, en milisegundos.
+ */
+#define CONFIG_MAX_SCRAPE_MIN_AGE_MS 3600000
+
+/**
+ * @brief Período de muestreo por defecto de las estadísticas en flujo, en milisegundos.
+ */
+#define CONFIG_DEFAULT_STATS_SAMPLE_MS 100
+
+/**
+ * @brief Período de muestreo máximo de las estadísticas en flujo, en milisegundos.
+ */
+#define CONFIG_MAX_STATS_SAMPLE_MS 60000
+
+/**
+ * @brief Ventana por defecto de las estadísticas en flujo, en segundos.
+ */
+#define CONFIG_DEFAULT_STATS_WINDOW_S 60
+
+/**
+ * @brief Ventana máxima de las estadísticas en flujo, en segundos.
+ */
+#define CONFIG_MAX_STATS_WINDOW_S 3600
+
+/**
+ * @brief Período mínimo por defecto del muestreo adaptativo, en milisegundos.
+ */
+#define CONFIG_DEFAULT_ADAPTIVE_MIN_MS 1000
+
+/**
+ * @brief Período máximo por defecto del muestreo adaptativo, en milisegundos.
+ */
+#define CONFIG_DEFAULT_ADAPTIVE_MAX_MS 60000
+
+/**
+ * @brief Cambio relativo por defecto (en %) a partir del cual un grupo se muestrea más seguido.
+ */
+#define CONFIG_DEFAULT_ADAPTIVE_CHANGE_PCT 10
+
+/**
+ * @brief Período máximo aceptado para el muestreo adaptativo, en milisegundos.
+ */
+#define CONFIG_MAX_ADAPTIVE_MS 3600000
+
+/**
+ * @brief Cantidad máxima de agentes que puede agregar el modo de federación.
+ */
+#define CONFIG_MAX_UPSTREAMS 256
+
+/**
+ * @brief Tamaño máximo de la dirección "host:puerto" de un agente, incluyendo el '\0'.
+ */
+#define CONFIG_UPSTREAM_SIZE 64
+
+/**
+ * @brief Plazo por defecto para scrapear cada agente, en milisegundos.
+ */
+#define CONFIG_DEFAULT_UPSTREAM_TIMEOUT_MS 1000
+
+/**
+ * @brief Plazo máximo aceptado para scrapear cada agente, en milisegundos.
+ */
+#define CONFIG_MAX_UPSTREAM_TIMEOUT_MS 60000
+
+/**
+ * @brief Capacidad máxima del anillo de eventos de procesos recientes.
+ */
+#define CONFIG_MAX_PROC_EVENTS_RING 4096
+
+/**
+ * @brief Cantidad máxima de procesos del top por tiempo de espera en la cola de ejecución.
+ */
+#define CONFIG_MAX_SCHEDSTAT_TOP_TASKS 32
+
+/**
+ * @brief Tamaño mínimo de la arena usada para parsear el archivo de configuración.
+ */
+#define CONFIG_PARSE_MIN (64 * 1024)
+
+/**
+ * @brief Bytes de arena reservados por cada byte del archivo (texto más nodos de cJSON).
+ */
+#define CONFIG_PARSE_FACTOR 32
+
+/**
+ * @brief Grupos de métricas que pueden habilitarse desde la configuración.
+ */
+typedef enum
+{
+    METRIC_GROUP_CPU,              /**< Uso de CPU. */
+    METRIC_GROUP_MEMORY,           /**< Uso de memoria. */
+    METRIC_GROUP_DISK_IO,          /**< Sectores leídos y escritos. */
+    METRIC_GROUP_NETWORK,          /**< Estadísticas de red. */
+    METRIC_GROUP_PROCESS_COUNT,    /**< Procesos en ejecución. */
+    METRIC_GROUP_CONTEXT_SWITCHES, /**< Cambios de contexto. */
+    METRIC_GROUP_STREAM_STATS,     /**< Estadísticas en flujo de CPU y memoria. */
+    METRIC_GROUP_PERF_EVENTS,      /**< Eventos de software por CPU mediante perf_event_open. */
+    METRIC_GROUP_PROC_EVENTS,      /**< Fork, exec y exit por CPU mediante el conector de netlink. */
+    METRIC_GROUP_SCHEDSTAT,        /**< Espera en la cola de ejecución y timeslices por CPU. */
+    METRIC_GROUP_COUNT             /**< Cantidad de grupos. */
+} metric_group_t;
+
+/**
+ * @brief Agente a agregar en el modo de federación.
+ *
+ * La dirección se valida al cargar la configuración, pero la resuelve el agregador (ver
+ * aggregator.h), que reintenta las que fallan sin invalidar la configuración.
+ */
+typedef struct
+{
+    char address[CONFIG_UPSTREAM_SIZE]; /**< "host:puerto" tal como figura en el archivo (etiqueta instance). */
+    char host[CONFIG_UPSTREAM_SIZE];    /**< Host, sin los corchetes de una dirección IPv6. */
+    char port[6];                       /**< Puerto, de 1 a 65535. */
+} config_upstream_t;
+
+/**
+ * @brief Configuración del agente. No se modifica una vez publicada.
+ */
+typedef struct
+{
+    int interval;                      /**< Segundos entre actualizaciones. */
+    bool enabled[METRIC_GROUP_COUNT];  /**< Grupos de métricas habilitados. */
+    bool collect_on_scrape;            /**< Recolectar al recibir un scrape en lugar de periódicamente. */
+    int scrape_min_age_ms;             /**< Antigüedad mínima de los valores para volver a recolectar. */
+    int stats_sample_ms;               /**< Período de muestreo de las estadísticas en flujo. */
+    int stats_window_s;                /**< Ventana de las estadísticas en flujo. */
+    bool adaptive;                     /**< Ajustar el período de cada grupo según cuánto cambia. */
+    int adaptive_min_ms;               /**< Período mínimo de un grupo en modo adaptativo. */
+    int adaptive_max_ms;               /**< Período máximo de un grupo en modo adaptativo. */
+    int adaptive_change_pct;           /**< Cambio relativo que acelera el muestreo de un grupo. */
+    config_upstream_t upstreams[CONFIG_MAX_UPSTREAMS]; /**< Agentes a agregar (modo de federación). */
+    int upstream_count;                /**< Cantidad de agentes; 0 expone las métricas locales. */
+    int upstream_timeout_ms;           /**< Plazo para scrapear cada agente. */
+    int proc_events_ring;              /**< Eventos de procesos recientes a guardar; 0 no guarda ninguno. */
+    int schedstat_top_tasks;           /**< Procesos que más esperan a exponer; 0 no recorre /proc. */
+    atomic_int refs;                   /**< Referencias vivas (uso interno). */
+} monitor_config_t;
+
+/**
+ * @brief Devuelve la clave JSON (dentro de "metrics") de un grupo de métricas.
+ *
+ * @param group Grupo de métricas.
+ * @return Nombre de la clave, por ejemplo "cpu" o "disk_io".
+ */
+const char* config_group_key(metric_group_t group);
+
+/**
+ * @brief Crea una configuración con los valores por defecto.
+ *
+ * Se habilitan los grupos básicos leídos de /proc; "stream_stats", "perf_events",
+ * "proc_events" y "schedstat" quedan deshabilitados porque requieren privilegios o tienen
+ * un costo propio. Las claves de métricas que faltan en el archivo toman estos mismos valores.
+ *
+ * @return Configuración nueva, o NULL si no hay memoria.
+ */
+monitor_config_t* config_defaults();
+
+/**
+ * @brief Lee y valida la configuración desde un archivo JSON.
+ *
+ * El archivo se valida por completo antes de devolver nada: un intervalo fuera de rango,
+ * una sección "metrics" ausente o una clave de métrica que no sea booleana invalidan todo
+ * el archivo. Las claves de métricas ausentes toman el valor por defecto de
+ * config_defaults().
+ *
+ * Claves opcionales: "collect_on_scrape" (booleano, por defecto false) recolecta al
+ * recibir cada scrape en lugar de cada "interval" segundos, y "scrape_min_age_ms"
+ * (por defecto 0) permite que los scrapes reutilicen valores más recientes que ese límite.
+ * "stats_sample_ms" y "stats_window_s" definen el muestreo y la ventana del grupo
+ * "stream_stats".
+ *
+ * Con "adaptive" en true cada grupo se recolecta con su propio período, entre
+ * "adaptive_min_ms" y "adaptive_max_ms": se acorta cuando sus valores cambian más de
+ * "adaptive_change_pct" por ciento entre muestras y se alarga mientras se mantienen estables.
+ *
+ * "upstreams" (arreglo de "host:puerto") activa el modo de federación: en lugar de las
+ * métricas locales se exponen las de esos agentes, scrapeadas en paralelo con un plazo de
+ * "upstream_timeout_ms" cada una. Una dirección mal formada invalida el archivo; una que no
+ * se puede resolver sólo deja a ese agente fuera hasta que se resuelva (ver aggregator.h).
+ *
+ * "proc_events_ring" (por defecto 0) guarda los últimos eventos del grupo "proc_events"
+ * para servirlos en /proc_events, y "schedstat_top_tasks" (por defecto 0) agrega al grupo
+ * "schedstat" los procesos que más esperaron en la cola de ejecución.
+ *
+ * @param config_filename Ruta del archivo de configuración.
+ * @return Configuración nueva, o NULL si el archivo no existe o es inválido.
+ */
+monitor_config_t* config_load(const char* config_filename);
+
+/**
+ * @brief Publica una configuración como la actual.
+ *
+ * El intercambio es atómico; la configuración anterior se libera cuando su último lector
+ * la suelta. La función toma la propiedad de @p config.
+ *
+ * @param config Configuración a publicar.
+ */
+void config_publish(monitor_config_t* config);
+
+/**
+ * @brief Obtiene una referencia a la configuración actual.
+ *
+ * Debe liberarse con config_release().
+ *
+ * @return Configuración actual, o NULL si todavía no se publicó ninguna.
+ */
+const monitor_config_t* config_acquire();
+
+/**
+ * @brief Suelta una referencia obtenida con config_acquire().
+ *
+ * @param config Configuración a soltar (puede ser NULL).
+ */
+void config_release(const monitor_config_t* config);
+
+/**
+ * @brief Comienza a vigilar el archivo de configuración con inotify.
+ *
+ * Se vigila el directorio que lo contiene, de modo que también se detectan los editores
+ * que reemplazan el archivo mediante rename().
+ *
+ * @param config_filename Ruta del archivo de configuración.
+ * @return Descriptor inotify no bloqueante, o -1 si no se pudo crear.
+ */
+int config_watch_init(const char* config_filename);
+
+/**
+ * @brief Consume los eventos pendientes del descriptor inotify.
+ *
+ * @param fd Descriptor devuelto por config_watch_init().
+ * @return true si alguno de los eventos corresponde al archivo de configuración.
+ */
+bool config_watch_changed(int fd);
+
+#endif // CONFIG_H
@@ -4,10 +4,11 @@
  * y exponerlos como métricas para Prometheus.
  */
 
+#include "config.h"
 #include "metrics.h"
+#include "registry.h"
 #include <errno.h>
-#include <prom.h>
-#include <promhttp.h>
+#include <microhttpd.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,10 +20,17 @@
  */
 #define BUFFER_SIZE 256
 
+/**
+ * @brief Puerto TCP en el que escucha el servidor HTTP de métricas.
+ */
+#define HTTP_PORT 8000
+
 /**
  * @brief Actualiza la métrica de uso de CPU.
  *
- * Lee el uso de CPU y actualiza la métrica correspondiente en Prometheus.
+ * Lee el uso de CPU y actualiza la métrica correspondiente en Prometheus. La métrica no se
+ * expone hasta que la primera muestra abarque CPU_USAGE_MIN_JIFFIES jiffies; mientras tanto
+ * se conserva la lectura de referencia.
  */
 void update_cpu_gauge();
 
@@ -66,25 +74,140 @@ void update_network_gauge();
 void update_process_count_gauge();
 
 /**
- * @brief Función del hilo para exponer las métricas vía HTTP en el puerto 8000.
+ * @brief Actualiza los contadores de eventos de software por CPU.
+ *
+ * Lee los grupos de perf_event_open de todas las CPUs (ver perf_events.h); si no están
+ * abiertos no hace nada.
+ */
+void update_perf_events_gauge();
+
+/**
+ * @brief Actualiza los contadores de fork, exec y exit por CPU.
+ *
+ * Lee los contadores que mantiene el hilo del conector de procesos (ver proc_events.h);
+ * si la suscripción no está activa no hace nada.
+ */
+void update_proc_events_gauge();
+
+/**
+ * @brief Actualiza las tasas de espera en la cola de ejecución y de timeslices.
+ *
+ * Lee /proc/schedstat (ver schedstat.h) y, si "schedstat_top_tasks" es mayor que 0,
+ * los procesos que más esperaron desde la recolección anterior.
+ */
+void update_schedstat_gauge();
+
+/**
+ * @brief Toma la lectura de referencia de las tasas de /proc/schedstat.
+ *
+ * No modifica el registro; la primera update_schedstat_gauge() posterior ya publica tasas
+ * válidas. No hace nada si el grupo "schedstat" está deshabilitado o no está disponible.
+ */
+void prime_schedstat_gauge();
+
+/**
+ * @brief Devuelve el mayor cambio relativo de un grupo desde la última llamada y lo reinicia.
+ *
+ * Para cada métrica del grupo se compara su nivel con el de la muestra anterior; en los
+ * contadores acumulados el nivel es su tasa por segundo, de modo que un contador que
+ * crece a ritmo constante se considera estable.
+ *
+ * @param group Grupo de métricas.
+ * @return Cambio relativo (0.1 equivale a un 10%), o 0 si todavía no hay dos muestras.
+ */
+double take_group_change(metric_group_t group);
+
+/**
+ * @brief Indica si la interfaz del kernel de la que se recolecta un grupo está abierta o presente.
+ *
+ * Los grupos "perf_events" y "proc_events" dependen de la última reconciliación (ver
+ * reconcile_metrics()) y "schedstat" de que exista /proc/schedstat; los demás siempre
+ * están disponibles.
+ *
+ * @param group Grupo de métricas.
+ * @return true si el grupo se puede recolectar.
+ */
+bool group_available(metric_group_t group);
+
+/**
+ * @brief Actualiza la métrica con la frecuencia de muestreo efectiva de un grupo.
+ *
+ * @param group Grupo de métricas.
+ * @param hertz Muestras por segundo (0 si el grupo está deshabilitado o no está disponible).
+ */
+void update_sample_rate_gauge(metric_group_t group, double hertz);
+
+/**
+ * @brief Actualiza la métrica con el tiempo hasta el primer scrape válido.
+ *
+ * Se llama apenas se abre el servidor HTTP; un scrape que llegue antes la ve en 0.
+ *
+ * @param seconds Segundos desde el inicio del agente hasta que hubo datos válidos y el
+ *                servidor HTTP pudo abrirse.
+ */
+void update_startup_gauge(double seconds);
+
+/**
+ * @brief Abre el servidor HTTP que expone las métricas en el puerto HTTP_PORT.
  *
- * Inicializa un servidor HTTP para servir las métricas recopiladas.
+ * Debe llamarse después de init_metrics() y de la primera recolección (ver
+ * prime_metrics()), de modo que el primer scrape ya encuentre valores válidos. Las
+ * conexiones se atienden en el pool de hilos de libmicrohttpd.
  *
- * @param arg Argumento no utilizado.
- * @return NULL
+ * @return EXIT_SUCCESS en caso de éxito, o EXIT_FAILURE si no se pudo abrir el puerto.
  */
-void* expose_metrics(void* arg);
+int start_http_server();
+
+/**
+ * @brief Cierra el servidor HTTP abierto con start_http_server().
+ */
+void stop_http_server();
 
 /**
  * @brief Inicializa el mutex y las métricas de Prometheus.
  *
- * Configura el mutex para la sincronización y crea las métricas que
- * serán expuestas a través de Prometheus.
+ * Configura el mutex para la sincronización, registra todas las métricas, reserva
+ * los buffers de salida y habilita los grupos de la configuración actual
+ * (ver config_acquire()).
  *
  * @return EXIT_SUCCESS en caso de éxito, o EXIT_FAILURE en caso de error.
  */
 int init_metrics();
 
+/**
+ * @brief Ajusta las métricas expuestas a una nueva configuración.
+ *
+ * Agrega al registro los grupos recién habilitados y quita los deshabilitados, sin
+ * reiniciar el servidor HTTP. Los grupos que no cambian conservan su último valor y
+ * el estado usado para calcular tasas.
+ *
+ * Abre y cierra las interfaces del kernel que leen los ciclos de recolección: una vez que
+ * puede haber ciclos en curso debe llamarse a través de reconcile_collection().
+ *
+ * @param config Configuración a aplicar.
+ * @return EXIT_SUCCESS en caso de éxito, o EXIT_FAILURE si no se pudo reconstruir el registro.
+ */
+int reconcile_metrics(const monitor_config_t* config);
+
+/**
+ * @brief Serializa las métricas en uno de los buffers de salida preasignados.
+ *
+ * No asigna memoria dinámica. El buffer queda reservado hasta llamar a release_scrape().
+ * El servidor HTTP elige el formato según el encabezado Accept del pedido.
+ *
+ * @param format Formato de exposición.
+ * @param[out] length Bytes escritos en el buffer.
+ * @return Buffer con la exposición, o NULL si no hay buffers libres o no se inicializaron.
+ */
+char* render_scrape(registry_format_t format, size_t* length);
+
+/**
+ * @brief Devuelve un buffer obtenido con render_scrape().
+ *
+ * @param buffer Buffer a liberar.
+ */
+void release_scrape(void* buffer);
+
 /**
  * @brief Destruye el mutex utilizado para la sincronización de hilos.
  *
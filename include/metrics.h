@@ -3,6 +3,7 @@
  * @brief Funciones para obtener estadísticas del sistema desde el sistema de archivos /proc.
  */
 
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,70 @@
  */
 #define BUFFER_SIZE 256
 
+/**
+ * @brief Tamaño inicial de la arena donde se leen los archivos de /proc en cada ciclo.
+ *
+ * Alcanza para los archivos que lee el muestreador (/proc/stat y /proc/meminfo) en una
+ * máquina chica; la arena se duplica cuando un ciclo lee más.
+ */
+#define PROC_ARENA_INITIAL_SIZE (16 * 1024)
+
+/**
+ * @brief Cantidad máxima de veces que la arena duplica su tamaño.
+ */
+#define PROC_ARENA_GROWTHS 6
+
+/**
+ * @brief Tamaño máximo de la arena; un archivo que no entre se descarta.
+ */
+#define PROC_ARENA_MAX_SIZE (1024 * 1024)
+
+/**
+ * @brief Jiffies de /proc/stat (sumados en todas las CPUs) que debe abarcar una muestra de
+ * uso de CPU para publicarse.
+ *
+ * El uso se calcula con una resolución de 100 / CPU_USAGE_MIN_JIFFIES puntos porcentuales;
+ * con menos jiffies, en una VM chica una muestra sólo podría valer 0, 50 o 100%. /proc/stat
+ * cuenta USER_HZ (típicamente 100) jiffies por segundo y por CPU, así que con una sola CPU
+ * hacen falta 200 ms.
+ */
+#define CPU_USAGE_MIN_JIFFIES 20
+
+/**
+ * @brief Tiempos acumulados de CPU leídos desde /proc/stat, en jiffies.
+ */
+typedef struct
+{
+    unsigned long long user;    /**< Modo usuario. */
+    unsigned long long nice;    /**< Modo usuario con prioridad reducida. */
+    unsigned long long system;  /**< Modo kernel. */
+    unsigned long long idle;    /**< Ocioso. */
+    unsigned long long iowait;  /**< Esperando E/S. */
+    unsigned long long irq;     /**< Atendiendo interrupciones. */
+    unsigned long long softirq; /**< Atendiendo softirqs. */
+    unsigned long long steal;   /**< Tomado por el hipervisor. */
+} cpu_times_t;
+
+/**
+ * @brief Libera los datos transitorios del ciclo de recolección anterior.
+ *
+ * Los archivos de /proc se leen en una arena por hilo que arranca en
+ * PROC_ARENA_INITIAL_SIZE y crece hasta ajustarse a lo que el hilo lee por ciclo; cada hilo
+ * que recolecta debe llamarla al comienzo de cada ciclo para reutilizarla.
+ */
+void metrics_tick_reset();
+
+/**
+ * @brief Lee un archivo de /proc completo en la arena del ciclo.
+ *
+ * Evita fopen(), que asigna un FILE y su buffer en cada llamada. El contenido es válido
+ * hasta el próximo metrics_tick_reset() del mismo hilo.
+ *
+ * @param path Ruta del archivo.
+ * @return Contenido terminado en '\0', o NULL en caso de error.
+ */
+char* read_proc_file(const char* path);
+
 /**
  * @brief Obtiene el porcentaje de uso de memoria desde /proc/meminfo.
  *
@@ -28,17 +93,72 @@ double get_memory_usage();
  * Lee los tiempos de CPU desde /proc/stat y calcula el porcentaje de uso de CPU
  * en un intervalo de tiempo.
  *
+ * La primera llamada sin prime_cpu_usage() previo sólo toma la lectura de referencia y
+ * devuelve -1.0.
+ *
  * @return Uso de CPU como porcentaje (0.0 a 100.0), o -1.0 en caso de error.
  */
 double get_cpu_usage();
 
+/**
+ * @brief Toma la lectura de referencia de get_cpu_usage().
+ *
+ * Así la primera llamada a get_cpu_usage() mide el uso desde esta lectura y no el
+ * promedio desde el arranque del sistema.
+ *
+ * @return 0 en caso de éxito, o -1 en caso de error.
+ */
+int prime_cpu_usage();
+
+/**
+ * @brief Jiffies transcurridos, sumados en todas las CPUs, desde la lectura de referencia de
+ * get_cpu_usage().
+ *
+ * Debe llamarse con la arena del ciclo reiniciada (ver metrics_tick_reset()).
+ *
+ * @return Jiffies transcurridos, o -1 si no hay lectura de referencia o no se pudo leer
+ *         /proc/stat.
+ */
+long long cpu_usage_elapsed_jiffies();
+
+/**
+ * @brief Lee los tiempos agregados de CPU desde /proc/stat.
+ *
+ * @param[out] times Tiempos leídos.
+ * @return 0 en caso de éxito, o -1 en caso de error.
+ */
+int get_cpu_times(cpu_times_t* times);
+
+/**
+ * @brief Calcula el porcentaje de uso de CPU entre dos lecturas de get_cpu_times().
+ *
+ * @param prev Lectura anterior.
+ * @param cur Lectura actual.
+ * @return Uso de CPU como porcentaje (0.0 a 100.0), o -1.0 si no transcurrió ningún jiffy.
+ */
+double cpu_usage_between(const cpu_times_t* prev, const cpu_times_t* cur);
+
+/**
+ * @brief Lee los tiempos acumulados de presión (PSI) de un recurso desde /proc/pressure.
+ *
+ * Debe llamarse con la arena del ciclo reiniciada (ver metrics_tick_reset()).
+ *
+ * @param resource "cpu", "io" o "memory".
+ * @param[out] totals Microsegundos acumulados con alguna tarea demorada por el recurso
+ *                    ("some") y con todas las tareas no ociosas demoradas ("full").
+ * @return Cantidad de líneas leídas (1 si el kernel no informa "full"), o -1 si PSI no
+ *         está disponible.
+ */
+int get_pressure_totals(const char* resource, unsigned long long totals[2]);
+
 /**
  * @brief Obtiene el número de cambios de contexto desde /proc/stat.
  *
  * Lee el valor correspondiente a los cambios de contexto (ctxt) desde /proc/stat,
  * que indica cuántas veces el sistema ha cambiado de un proceso a otro.
  *
- * @return Número de cambios de contexto, o 1 en caso de error al abrir el archivo.
+ * @return Número de cambios de contexto, o (unsigned long long)-1 si no se pudo leer o parsear
+ *         el archivo.
  */
 unsigned long long int get_ctxt();
 
@@ -49,8 +169,9 @@ unsigned long long int get_ctxt();
  *
  * @param[out] reads Puntero donde se almacenará el total de sectores leídos.
  * @param[out] writes Puntero donde se almacenará el total de sectores escritos.
+ * @return 0 en caso de éxito, o -1 si no se pudo leer el archivo (los totales quedan en 0).
  */
-void get_disk_io(unsigned long long* reads, unsigned long long* writes);
+int get_disk_io(unsigned long long* reads, unsigned long long* writes);
 
 /**
  * @brief Obtiene estadísticas de red desde /proc/net/dev.
@@ -63,9 +184,10 @@ void get_disk_io(unsigned long long* reads, unsigned long long* writes);
  * @param[out] rx_errors Puntero donde se almacenará el total de errores de recepción.
  * @param[out] tx_errors Puntero donde se almacenará el total de errores de transmisión.
  * @param[out] collisions Puntero donde se almacenará el total de colisiones.
+ * @return 0 en caso de éxito, o -1 si no se pudo leer el archivo (los totales quedan en 0).
  */
-void get_network_stats(unsigned long long* rx_bytes, unsigned long long* tx_bytes, unsigned long long* rx_errors,
-                       unsigned long long* tx_errors, unsigned long long* collisions);
+int get_network_stats(unsigned long long* rx_bytes, unsigned long long* tx_bytes, unsigned long long* rx_errors,
+                      unsigned long long* tx_errors, unsigned long long* collisions);
 
 /**
  * @brief Obtiene el número de procesos en ejecución desde /proc/stat.
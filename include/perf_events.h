@@ -0,0 +1,68 @@
+/**
+ * @file perf_events.h
+ * @brief Contadores de eventos de software del kernel por CPU mediante perf_event_open.
+ *
+ * Por cada CPU se abre un grupo con cuatro eventos de software (cambios de contexto,
+ * migraciones, fallos de página y fallos de página mayores) que se lee con un único
+ * read() por CPU, sin parsear texto. Los eventos de software no requieren una PMU de
+ * hardware, de modo que funcionan también en máquinas virtuales.
+ *
+ * Contar todos los procesos de una CPU requiere perf_event_paranoid <= 0 o CAP_PERFMON;
+ * si el kernel no lo permite, el grupo "perf_events" no se expone y los cambios de
+ * contexto siguen leyéndose de /proc/stat.
+ */
+
+#ifndef PERF_EVENTS_H
+#define PERF_EVENTS_H
+
+#include "platform.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Iteraciones de cada lectura en el benchmark (`make perf_bench`).
+ */
+#define PERF_BENCH_ROUNDS 100000
+
+/**
+ * @brief Eventos de software contados en cada CPU, en el orden del grupo.
+ */
+typedef enum
+{
+    PERF_EVENT_CONTEXT_SWITCHES, /**< PERF_COUNT_SW_CONTEXT_SWITCHES (líder del grupo). */
+    PERF_EVENT_CPU_MIGRATIONS,   /**< PERF_COUNT_SW_CPU_MIGRATIONS. */
+    PERF_EVENT_PAGE_FAULTS,      /**< PERF_COUNT_SW_PAGE_FAULTS. */
+    PERF_EVENT_MAJOR_FAULTS,     /**< PERF_COUNT_SW_PAGE_FAULTS_MAJ. */
+    PERF_EVENT_COUNT             /**< Cantidad de eventos. */
+} perf_event_id_t;
+
+/**
+ * @brief Abre los grupos de eventos de todas las CPUs.
+ *
+ * Las CPUs fuera de línea se omiten y sus contadores quedan en 0.
+ *
+ * @return 0 en caso de éxito, o -1 si perf_event_open no está disponible o no está permitido.
+ */
+int perf_events_open();
+
+/**
+ * @brief Cierra los grupos abiertos con perf_events_open().
+ */
+void perf_events_close();
+
+/**
+ * @brief Indica si los grupos están abiertos.
+ *
+ * @return true si perf_events_open() tuvo éxito y no se cerraron.
+ */
+bool perf_events_available();
+
+/**
+ * @brief Lee los contadores de todas las CPUs, con un read() por CPU.
+ *
+ * @param[out] counts Contadores acumulados desde la apertura, indexados por CPU y evento.
+ * @return 0 en caso de éxito, o -1 si los grupos no están abiertos o falla la lectura.
+ */
+int perf_events_read(uint64_t counts[PLATFORM_MAX_CPUS][PERF_EVENT_COUNT]);
+
+#endif // PERF_EVENTS_H
@@ -0,0 +1,48 @@
+/**
+ * @file platform.h
+ * @brief Reloj monótono y CPUs monitoreadas, compartidos por todos los recolectores.
+ *
+ * Las métricas por CPU (perf_events, proc_events y schedstat) se dimensionan con
+ * PLATFORM_MAX_CPUS y siguen una misma regla: se monitorean las CPUs 0 a
+ * platform_cpu_count() - 1, y las lecturas o eventos de CPUs con índice mayor o igual que
+ * PLATFORM_MAX_CPUS se descartan (nunca se suman a otra CPU). Si la máquina tiene más CPUs,
+ * se avisa una vez por stderr.
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Cantidad máxima de CPUs monitoreadas.
+ */
+#define PLATFORM_MAX_CPUS 128
+
+/**
+ * @brief Instante actual de CLOCK_MONOTONIC, en nanosegundos.
+ *
+ * @return Nanosegundos desde un origen arbitrario, no decrecientes.
+ */
+int64_t platform_now_ns();
+
+/**
+ * @brief Consulta una sola vez la cantidad de CPUs configuradas y la guarda.
+ *
+ * sysconf(_SC_NPROCESSORS_CONF) puede leer /sys y asignar memoria, así que se llama sólo
+ * al arrancar (desde main(), antes de abrir los recolectores) y no en cada scrape.
+ *
+ * @return Cantidad de CPUs monitoreadas (al menos 1).
+ */
+int platform_init();
+
+/**
+ * @brief Cantidad de CPUs monitoreadas: las configuradas, hasta PLATFORM_MAX_CPUS.
+ *
+ * Devuelve el valor guardado por platform_init(); si todavía no se llamó, la llama.
+ *
+ * @return Cantidad de CPUs (al menos 1).
+ */
+int platform_cpu_count();
+
+#endif // PLATFORM_H
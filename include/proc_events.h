@@ -0,0 +1,118 @@
+/**
+ * @file proc_events.h
+ * @brief Eventos del ciclo de vida de los procesos mediante el conector de procesos de netlink.
+ *
+ * Un hilo dedicado se suscribe al conector (PROC_EVENT_FORK, PROC_EVENT_EXEC y
+ * PROC_EVENT_EXIT) y cuenta cada evento al llegar, en lugar de volver a recorrer /proc en
+ * cada intervalo. Así no se pierden las ráfagas de fork ni los procesos de vida corta que
+ * nacen y terminan entre dos muestras.
+ *
+ * Los contadores son por CPU (la CPU que informa el kernel en cada evento), cada una en
+ * su propia línea de caché, y se leen sin tomar ningún lock. Opcionalmente se guardan los
+ * últimos "proc_events_ring" eventos en un anillo acotado que se sirve en /proc_events.
+ *
+ * Según el kernel, suscribirse puede requerir CAP_NET_ADMIN; si la suscripción falla el grupo
+ * "proc_events" no se expone.
+ */
+
+#ifndef PROC_EVENTS_H
+#define PROC_EVENTS_H
+
+#include "platform.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Tamaño máximo de la línea de texto de un evento en /proc_events, incluyendo el '\n'.
+ */
+#define PROC_EVENTS_LINE_SIZE 96
+
+/**
+ * @brief Eventos contados en cada CPU.
+ */
+typedef enum
+{
+    PROC_EVENT_KIND_FORK,     /**< Creación de un proceso (no se cuentan los hilos). */
+    PROC_EVENT_KIND_EXEC,     /**< Reemplazo de la imagen de un proceso con exec(). */
+    PROC_EVENT_KIND_EXIT,     /**< Terminación de un proceso. */
+    PROC_EVENT_KIND_FAILED,   /**< Terminación con un código de salida distinto de 0. */
+    PROC_EVENT_KIND_SIGNALED, /**< Terminación por una señal. */
+    PROC_EVENT_KIND_COUNT     /**< Cantidad de eventos. */
+} proc_event_kind_t;
+
+/**
+ * @brief Evento guardado en el anillo de eventos recientes.
+ */
+typedef struct
+{
+    uint64_t timestamp_ns;  /**< Instante del evento según el kernel (desde el arranque). */
+    proc_event_kind_t kind; /**< FORK, EXEC o EXIT. */
+    pid_t pid;              /**< Proceso hijo, proceso que hizo exec() o proceso que terminó. */
+    pid_t parent_pid;       /**< Padre del hijo en FORK; 0 en los demás. */
+    int cpu;                /**< CPU que informó el evento. */
+    uint32_t exit_code;     /**< Estado de wait() en EXIT; 0 en los demás. */
+} proc_event_t;
+
+/**
+ * @brief Se suscribe al conector de procesos y arranca el hilo que recibe los eventos.
+ *
+ * Los contadores y el anillo se reinician.
+ *
+ * @return 0 en caso de éxito, o -1 si no hay permiso o el kernel no tiene el conector.
+ */
+int proc_events_open();
+
+/**
+ * @brief Cancela la suscripción y espera a que termine el hilo.
+ */
+void proc_events_close();
+
+/**
+ * @brief Indica si la suscripción está activa.
+ *
+ * @return true si proc_events_open() tuvo éxito y no se cerró.
+ */
+bool proc_events_available();
+
+/**
+ * @brief Lee los contadores de todas las CPUs sin bloquear al hilo receptor.
+ *
+ * @param[out] counts Eventos desde la apertura, indexados por CPU y tipo de evento.
+ * @param[out] overrun_count Veces que el kernel informó que el socket se desbordó (ENOBUFS);
+ *                           cada una puede haber descartado varios eventos, que no se cuentan.
+ * @return 0 en caso de éxito, o -1 si la suscripción no está activa.
+ */
+int proc_events_read(uint64_t counts[PLATFORM_MAX_CPUS][PROC_EVENT_KIND_COUNT], uint64_t* overrun_count);
+
+/**
+ * @brief Fija cuántos eventos recientes se guardan; 0 deshabilita el anillo.
+ *
+ * Cambiar la capacidad descarta los eventos guardados.
+ *
+ * @param capacity Eventos a guardar, hasta CONFIG_MAX_PROC_EVENTS_RING.
+ */
+void proc_events_set_ring(int capacity);
+
+/**
+ * @brief Escribe los eventos recientes, del más antiguo al más nuevo, uno por línea.
+ *
+ * Cada línea tiene la forma "<timestamp_ns> <fork|exec|exit> pid=<pid> ppid=<ppid>
+ * cpu=<cpu> code=<código>"; el tamaño necesario está acotado por
+ * capacidad * PROC_EVENTS_LINE_SIZE.
+ *
+ * @param out Buffer de salida.
+ * @param cap Tamaño de @p out.
+ * @return Bytes escritos (sin '\0'); los eventos que no entran se omiten.
+ */
+size_t proc_events_render_ring(char* out, size_t cap);
+
+/**
+ * @brief Capacidad vigente del anillo de eventos recientes.
+ *
+ * @return Eventos que se guardan, o 0 si el anillo está deshabilitado.
+ */
+int proc_events_ring_capacity();
+
+#endif // PROC_EVENTS_H
@@ -0,0 +1,170 @@
+/**
+ * @file registry.h
+ * @brief Registro de métricas con almacenamiento de series preasignado.
+ *
+ * Todas las familias y series se reservan en arreglos estáticos al iniciar; actualizar
+ * un valor o serializar el registro no asigna memoria dinámica. Las funciones no son
+ * thread-safe: el llamador debe sincronizar el acceso (ver expose_metrics.c).
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Cantidad máxima de familias de métricas.
+ */
+#define REGISTRY_MAX_FAMILIES 128
+
+/**
+ * @brief Cantidad máxima de series entre todas las familias.
+ */
+#define REGISTRY_MAX_SERIES 2048
+
+/**
+ * @brief Tamaño máximo de las etiquetas de una serie, ya formateadas (`cpu="3",mode="idle"`).
+ */
+#define SERIES_LABELS_SIZE 64
+
+/**
+ * @brief Longitud máxima del sufijo del nombre de una serie (por ejemplo "_count").
+ */
+#define SERIES_SUFFIX_MAX 16
+
+/**
+ * @brief Grupo de las familias que se exponen siempre, sin importar la configuración.
+ */
+#define METRIC_GROUP_ALWAYS METRIC_GROUP_COUNT
+
+/**
+ * @brief Tipo de una familia de métricas.
+ */
+typedef enum
+{
+    METRIC_TYPE_GAUGE,   /**< Valor que sube y baja. */
+    METRIC_TYPE_COUNTER, /**< Valor monótonamente creciente; en todos los formatos se expone como <nombre>_total. */
+    METRIC_TYPE_SUMMARY  /**< Cuantiles (etiqueta quantile) más series _sum y _count. */
+} metric_type_t;
+
+/**
+ * @brief Formato de exposición.
+ */
+typedef enum
+{
+    REGISTRY_FORMAT_TEXT,        /**< Formato de texto de Prometheus 0.0.4. */
+    REGISTRY_FORMAT_OPENMETRICS, /**< OpenMetrics 1.0.0, con timestamps de creación y exemplars. */
+    REGISTRY_FORMAT_PROTOBUF     /**< io.prometheus.client.MetricFamily delimitados por longitud. */
+} registry_format_t;
+
+/**
+ * @brief Registra una familia de métricas con @p series_count series.
+ *
+ * Las series comienzan en 0 y sin etiquetas.
+ *
+ * @param name Nombre de la métrica (debe permanecer válido mientras exista el registro).
+ * @param help Texto de ayuda (debe permanecer válido mientras exista el registro).
+ * @param type Tipo de la métrica.
+ * @param group Grupo de configuración que la habilita, o METRIC_GROUP_ALWAYS.
+ * @param series_count Cantidad de series de la familia.
+ * @return Identificador de la familia, o -1 si se superan los límites del registro.
+ */
+int registry_add_family(const char* name, const char* help, metric_type_t type, metric_group_t group,
+                        size_t series_count);
+
+/**
+ * @brief Asigna las etiquetas de una serie.
+ *
+ * @param family Identificador de la familia.
+ * @param index Índice de la serie dentro de la familia.
+ * @param labels Etiquetas ya formateadas, sin llaves (se truncan a SERIES_LABELS_SIZE).
+ */
+void registry_set_labels(int family, size_t index, const char* labels);
+
+/**
+ * @brief Asigna un sufijo al nombre de una serie, como "_sum" o "_count" en un summary.
+ *
+ * @param family Identificador de la familia.
+ * @param index Índice de la serie dentro de la familia.
+ * @param suffix Sufijo constante de hasta SERIES_SUFFIX_MAX caracteres.
+ */
+void registry_set_suffix(int family, size_t index, const char* suffix);
+
+/**
+ * @brief Actualiza el valor de una serie.
+ *
+ * @param family Identificador de la familia.
+ * @param index Índice de la serie dentro de la familia.
+ * @param value Nuevo valor.
+ */
+void registry_set(int family, size_t index, double value);
+
+/**
+ * @brief Asigna el instante de creación de una serie (contadores y summaries).
+ *
+ * Sólo se expone en OpenMetrics (serie _created) y en protobuf (created_timestamp).
+ *
+ * @param family Identificador de la familia.
+ * @param index Índice de la serie dentro de la familia.
+ * @param seconds Segundos desde la época Unix, o 0 para no exponerlo.
+ */
+void registry_set_created(int family, size_t index, double seconds);
+
+/**
+ * @brief Asigna el exemplar de una serie de un contador.
+ *
+ * Sólo se expone en OpenMetrics y en protobuf.
+ *
+ * @param family Identificador de la familia.
+ * @param index Índice de la serie dentro de la familia.
+ * @param labels Etiquetas del exemplar ya formateadas, sin llaves (puede ser "").
+ * @param value Valor de la observación.
+ * @param timestamp Instante de la observación, en segundos desde la época Unix.
+ */
+void registry_set_exemplar(int family, size_t index, const char* labels, double value, double timestamp);
+
+/**
+ * @brief Limita las series expuestas de una familia a las primeras @p count.
+ *
+ * Sirve para familias de tamaño variable, como un top-N; las series restantes conservan
+ * sus valores y etiquetas pero no se serializan. Por defecto se exponen todas.
+ *
+ * @param family Identificador de la familia.
+ * @param count Series a exponer (se limita a las registradas).
+ */
+void registry_set_active_series(int family, size_t count);
+
+/**
+ * @brief Habilita o deshabilita la exposición de todas las familias de un grupo.
+ *
+ * Los valores se conservan mientras el grupo está deshabilitado.
+ *
+ * @param group Grupo de configuración.
+ * @param enabled true para exponer sus familias.
+ */
+void registry_enable_group(metric_group_t group, bool enabled);
+
+/**
+ * @brief Cota superior del tamaño del registro serializado en cualquier formato, con todos los
+ * grupos habilitados.
+ *
+ * @return Bytes necesarios para registry_render(), incluyendo el '\0' final.
+ */
+size_t registry_render_bound();
+
+/**
+ * @brief Serializa las familias habilitadas directamente en @p out.
+ *
+ * En protobuf cada summary se codifica como una única métrica: las series con etiqueta
+ * quantile forman sus cuantiles y las de sufijo _sum y _count, su suma y su cuenta.
+ *
+ * @param out Buffer de salida.
+ * @param capacity Tamaño del buffer.
+ * @param format Formato de exposición.
+ * @return Bytes escritos (sin el '\0' final), o 0 si el buffer es demasiado chico.
+ */
+size_t registry_render(char* out, size_t capacity, registry_format_t format);
+
+#endif // REGISTRY_H
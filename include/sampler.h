@@ -0,0 +1,64 @@
+/**
+ * @file sampler.h
+ * @brief Muestreo interno de alta frecuencia con estadísticas en flujo por serie.
+ *
+ * Un hilo muestrea el uso de memoria y la presión (PSI) de CPU, E/S y memoria cada
+ * "stats_sample_ms" milisegundos y mantiene, sobre una ventana de "stats_window_s" segundos,
+ * la EWMA, el mínimo, el máximo y un DDSketch de cada serie (ver stats.h). Los resúmenes se
+ * calculan al momento del scrape y se exponen como métricas de tipo summary más gauges de
+ * EWMA y extremos.
+ *
+ * La presión se muestrea de /proc/pressure/{cpu,io,memory}: el "total" de las líneas "some"
+ * y "full" acumula microsegundos de demora, así que cada muestra es el porcentaje del
+ * intervalo en que hubo tareas demoradas, con resolución de sobra a 1 ms. Si el kernel no
+ * tiene PSI, esas series no se exponen.
+ *
+ * El uso de CPU, en cambio, sale de los jiffies de /proc/stat, que avanzan a USER_HZ
+ * (típicamente 100 Hz) por CPU: a 1 ms casi todas las muestras serían 0 % o 100 %. Por eso
+ * la CPU se muestrea con su propio período, el mayor entre "stats_sample_ms" y el necesario
+ * para que transcurran SAMPLER_CPU_MIN_JIFFIES jiffies entre todas las CPUs (1 s en una
+ * máquina de una CPU, 125 ms con ocho).
+ *
+ * Los cuantiles de cada summary son los de la ventana, pero su _sum y su _count acumulan
+ * todas las muestras desde el arranque, como exige el tipo; la suma y la cantidad de
+ * muestras de la ventana se exponen como gauges aparte.
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/**
+ * @brief Jiffies, sumados en todas las CPUs, que debe abarcar cada muestra de uso de CPU.
+ *
+ * Con 100 jiffies, el uso de CPU de cada muestra tiene una resolución de 1 %.
+ */
+#define SAMPLER_CPU_MIN_JIFFIES 100
+
+/**
+ * @brief Registra las familias de las estadísticas en flujo.
+ *
+ * Debe llamarse antes de dimensionar los buffers de salida.
+ *
+ * @return EXIT_SUCCESS en caso de éxito, o EXIT_FAILURE si el registro está lleno.
+ */
+int init_stream_stats();
+
+/**
+ * @brief Publica en el registro el resumen de la ventana vigente.
+ *
+ * Debe llamarse con el mutex del registro tomado, justo antes de serializarlo.
+ */
+void publish_stream_stats();
+
+/**
+ * @brief Función del hilo de muestreo de alta frecuencia.
+ *
+ * Mientras el grupo "stream_stats" está deshabilitado, el hilo sólo revisa la
+ * configuración una vez por segundo.
+ *
+ * @param arg Argumento no utilizado.
+ * @return NULL
+ */
+void* sample_metrics(void* arg);
+
+#endif // SAMPLER_H
@@ -0,0 +1,86 @@
+/**
+ * @file schedstat.h
+ * @brief Latencia de la cola de ejecución por CPU desde /proc/schedstat y por proceso desde
+ * /proc/[pid]/schedstat.
+ *
+ * De cada CPU se toman el tiempo acumulado que las tareas esperaron en su cola de ejecución
+ * (run delay) y la cantidad de timeslices ejecutados, y se exponen como tasas por segundo
+ * entre dos lecturas. Un run delay creciente indica saturación de CPU antes de que el uso
+ * llegue al 100%.
+ *
+ * Opcionalmente se recorre /proc para obtener los "schedstat_top_tasks" procesos que más
+ * esperaron desde la lectura anterior. /proc/[pid]/schedstat corresponde al hilo principal
+ * de cada proceso. Sus series se identifican sólo por el puesto ("rank"), para que la
+ * cantidad de series no crezca con cada proceso que pasa por el top; el pid y el nombre
+ * de quien ocupa cada puesto se exponen aparte en "process_sched_top_task_info".
+ *
+ * Requiere un kernel con CONFIG_SCHEDSTATS; si /proc/schedstat no existe el grupo
+ * "schedstat" no se expone.
+ */
+
+#ifndef SCHEDSTAT_H
+#define SCHEDSTAT_H
+
+#include "platform.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * @brief Cantidad máxima de procesos cuya lectura anterior se conserva para calcular tasas.
+ */
+#define SCHEDSTAT_MAX_TASKS 32768
+
+/**
+ * @brief Tamaño del nombre de un proceso (/proc/[pid]/comm), incluyendo el '\0'.
+ */
+#define SCHEDSTAT_COMM_SIZE 16
+
+/**
+ * @brief Tasas de una CPU o de un proceso entre dos lecturas.
+ */
+typedef struct
+{
+    double run_delay;  /**< Segundos de espera en la cola de ejecución por segundo. */
+    double timeslices; /**< Timeslices ejecutados por segundo. */
+} schedstat_rates_t;
+
+/**
+ * @brief Proceso del top por tiempo de espera en la cola de ejecución.
+ */
+typedef struct
+{
+    pid_t pid;                      /**< Identificador del proceso. */
+    char comm[SCHEDSTAT_COMM_SIZE]; /**< Nombre del proceso. */
+    schedstat_rates_t rates;        /**< Tasas desde la lectura anterior. */
+} schedstat_task_t;
+
+/**
+ * @brief Indica si el kernel expone /proc/schedstat.
+ *
+ * @return true si el archivo se puede leer.
+ */
+bool schedstat_available();
+
+/**
+ * @brief Lee /proc/schedstat y calcula las tasas de cada CPU desde la lectura anterior.
+ *
+ * Las CPUs sin lectura anterior (la primera vez, o fuera de línea) quedan en 0. Debe
+ * llamarse con la arena del ciclo reiniciada (ver metrics_tick_reset()).
+ *
+ * @param[out] rates Tasas indexadas por CPU.
+ * @return 0 en caso de éxito, o -1 si no se pudo leer o parsear el archivo.
+ */
+int schedstat_read_cpus(schedstat_rates_t rates[PLATFORM_MAX_CPUS]);
+
+/**
+ * @brief Recorre los procesos y devuelve los que más esperaron en la cola de ejecución.
+ *
+ * Los procesos sin lectura anterior no entran al top hasta la llamada siguiente.
+ *
+ * @param[out] top Procesos ordenados de mayor a menor run delay.
+ * @param max Tamaño de @p top.
+ * @return Cantidad de procesos escritos en @p top, o -1 si no se pudo leer /proc.
+ */
+int schedstat_top_tasks(schedstat_task_t* top, int max);
+
+#endif // SCHEDSTAT_H
@@ -0,0 +1,110 @@
+/**
+ * @file stats.h
+ * @brief Estadísticas en flujo por serie: EWMA, mínimo/máximo en ventana y cuantiles.
+ *
+ * La ventana se divide en STATS_WINDOW_BUCKETS intervalos; cada muestra sólo actualiza
+ * el intervalo actual (EWMA, mínimo, máximo, suma, cantidad y un bin de un DDSketch), de
+ * modo que agregar una muestra es O(1) y no asigna memoria. Al resumir se combinan los
+ * intervalos que siguen dentro de la ventana; los sketches son combinables por suma de bins.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Cantidad de intervalos en que se divide la ventana.
+ */
+#define STATS_WINDOW_BUCKETS 8
+
+/**
+ * @brief Cantidad de bins del DDSketch de cada intervalo.
+ */
+#define SKETCH_BINS 512
+
+/**
+ * @brief Error relativo máximo de los cuantiles estimados.
+ */
+#define SKETCH_RELATIVE_ACCURACY 0.02
+
+/**
+ * @brief Menor valor que se distingue de cero; los menores caen en el bin de ceros.
+ *
+ * Con SKETCH_BINS y SKETCH_RELATIVE_ACCURACY, los valores se distinguen hasta ~7e5;
+ * los mayores se acumulan en el último bin.
+ */
+#define SKETCH_MIN_VALUE 1e-3
+
+/**
+ * @brief Agregados de un intervalo de la ventana.
+ */
+typedef struct
+{
+    int64_t start_ns;            /**< Comienzo del intervalo (CLOCK_MONOTONIC). */
+    uint32_t count;              /**< Muestras en el intervalo. */
+    uint32_t zero_count;         /**< Muestras menores que SKETCH_MIN_VALUE. */
+    double sum;                  /**< Suma de las muestras. */
+    double min;                  /**< Mínimo del intervalo. */
+    double max;                  /**< Máximo del intervalo. */
+    uint32_t bins[SKETCH_BINS];  /**< Bins logarítmicos del DDSketch. */
+} stats_bucket_t;
+
+/**
+ * @brief Estado de las estadísticas en flujo de una serie.
+ */
+typedef struct
+{
+    double ewma;                                   /**< Media móvil exponencial. */
+    double alpha;                                  /**< Peso de cada muestra en la EWMA. */
+    int has_ewma;                                  /**< Indica si la EWMA ya tiene valor. */
+    int current;                                   /**< Intervalo que recibe las muestras. */
+    int64_t bucket_ns;                             /**< Duración de cada intervalo. */
+    stats_bucket_t buckets[STATS_WINDOW_BUCKETS];  /**< Intervalos de la ventana. */
+} stream_stats_t;
+
+/**
+ * @brief Resumen de la ventana de una serie.
+ */
+typedef struct
+{
+    double ewma;    /**< Media móvil exponencial. */
+    double min;     /**< Mínimo en la ventana. */
+    double max;     /**< Máximo en la ventana. */
+    double sum;     /**< Suma de las muestras en la ventana. */
+    uint64_t count; /**< Muestras en la ventana. */
+} stats_summary_t;
+
+/**
+ * @brief Inicializa (o reinicia) las estadísticas de una serie.
+ *
+ * @param stats Estadísticas a inicializar.
+ * @param window_s Duración de la ventana, en segundos; también es la constante de tiempo de la EWMA.
+ * @param sample_s Período de muestreo, en segundos.
+ */
+void stats_init(stream_stats_t* stats, double window_s, double sample_s);
+
+/**
+ * @brief Agrega una muestra.
+ *
+ * @param stats Estadísticas de la serie.
+ * @param value Valor muestreado (los negativos se tratan como cero).
+ * @param now_ns Instante de la muestra (CLOCK_MONOTONIC), no decreciente.
+ */
+void stats_add(stream_stats_t* stats, double value, int64_t now_ns);
+
+/**
+ * @brief Resume la ventana vigente en @p now_ns.
+ *
+ * @param stats Estadísticas de la serie.
+ * @param now_ns Instante del resumen (CLOCK_MONOTONIC).
+ * @param quantiles Cuantiles a estimar, entre 0 y 1.
+ * @param count Cantidad de cuantiles.
+ * @param[out] values Cuantiles estimados (0 si la ventana está vacía).
+ * @param[out] summary EWMA, extremos, suma y cantidad de la ventana.
+ */
+void stats_summarize(const stream_stats_t* stats, int64_t now_ns, const double* quantiles, size_t count,
+                     double* values, stats_summary_t* summary);
+
+#endif // STATS_H
@@ -0,0 +1,845 @@
+#include "../include/aggregator.h"
+#include "../include/platform.h"
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Tamaño del pedido HTTP enviado a cada agente */
+#define REQUEST_SIZE 192
+
+/** Etapa del scrape de un agente */
+typedef enum
+{
+    TARGET_CONNECTING,
+    TARGET_SENDING,
+    TARGET_RECEIVING,
+    TARGET_DONE,
+    TARGET_FAILED
+} target_phase_t;
+
+/** Líneas contiguas de una familia dentro de la respuesta de un agente */
+typedef struct
+{
+    const char* name;
+    size_t name_length;
+    const char* type; // Tipo de la línea TYPE, o NULL si la familia no la tiene
+    size_t type_length;
+    const char* start;
+    const char* end;
+} family_block_t;
+
+/** Scrape en curso o terminado de un agente */
+typedef struct
+{
+    char address[CONFIG_UPSTREAM_SIZE]; // Agente al que corresponde addr
+    struct sockaddr_storage addr;
+    socklen_t addr_len;  // 0 mientras el agente no se pudo resolver
+    int64_t resolved_ns; // Último intento de resolución
+    bool stale;          // El último scrape falló: conviene volver a resolver
+    int fd;
+    target_phase_t phase;
+    int64_t started_ns;
+    int64_t deadline_ns;
+    double duration; // Segundos que tardó el último scrape
+    char request[REQUEST_SIZE];
+    size_t request_length;
+    size_t sent;
+    char* response; // AGGREGATE_RESPONSE_MAX bytes, reservados en el primer scrape y reutilizados
+    size_t received;
+    family_block_t blocks[AGGREGATE_MAX_FAMILIES];
+    size_t block_count;
+    int dropped_families; // Familias de la respuesta que no entraron en blocks
+} target_t;
+
+/** Exposición fusionada; refs cuenta los envíos en curso más uno mientras es la actual o se construye */
+typedef struct
+{
+    char* data;
+    size_t capacity;
+    size_t length; // Bytes escritos, o que se habrían escrito si no alcanza la capacidad
+    int refs;
+} snapshot_t;
+
+/** Scrape de cada agente, en el orden de "upstreams" */
+static target_t targets[CONFIG_MAX_UPSTREAMS];
+
+/** Descriptores a esperar con poll() y el agente de cada uno */
+static struct pollfd poll_fds[CONFIG_MAX_UPSTREAMS];
+static int poll_targets[CONFIG_MAX_UPSTREAMS];
+
+/** Nombres de las familias de la exposición fusionada, en orden de aparición */
+static family_block_t merged_families[AGGREGATE_MAX_FAMILIES];
+
+/** Familias de cada agente que quedaron fuera de la última exposición fusionada por superar
+ * AGGREGATE_MAX_FAMILIES */
+static int dropped_families[CONFIG_MAX_UPSTREAMS];
+
+/** Familias de cada agente que quedaron fuera de la última exposición fusionada porque su TYPE
+ * difiere del de la familia fusionada */
+static int type_conflicts[CONFIG_MAX_UPSTREAMS];
+
+/** Exposiciones fusionadas, reutilizadas entre actualizaciones */
+static snapshot_t snapshots[AGGREGATE_SNAPSHOTS];
+
+/** Última exposición publicada */
+static snapshot_t* current_snapshot;
+
+/** Protege las exposiciones y el estado de las actualizaciones */
+static pthread_mutex_t aggregate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Señala el fin de una actualización a los scrapes que esperan */
+static pthread_cond_t aggregate_done = PTHREAD_COND_INITIALIZER;
+
+/** Indica si hay una actualización en curso */
+static bool refreshing;
+
+/** Cantidad de actualizaciones terminadas */
+static unsigned long generation;
+
+/** Instante (CLOCK_MONOTONIC, en nanosegundos) en que terminó la última actualización */
+static int64_t last_refresh_ns;
+
+/**
+ * @brief Termina el scrape de un agente, cerrando su conexión.
+ */
+static void finish_target(target_t* target, target_phase_t phase)
+{
+    if (target->fd >= 0)
+    {
+        close(target->fd);
+        target->fd = -1;
+    }
+    target->phase = phase;
+    target->stale = phase == TARGET_FAILED;
+    target->duration = (platform_now_ns() - target->started_ns) / 1e9;
+}
+
+/**
+ * @brief Resuelve la dirección de un agente si hace falta.
+ *
+ * Se resuelve la primera vez, cada AGGREGATE_RESOLVE_TTL_S segundos y, con un mínimo de
+ * AGGREGATE_RESOLVE_RETRY_S segundos entre intentos, mientras no se pudo resolver o sus
+ * scrapes fallan. Si un nuevo intento falla se conserva la dirección anterior.
+ *
+ * @return true si hay una dirección a la cual conectarse.
+ */
+static bool resolve_target(target_t* target, const config_upstream_t* upstream, int64_t now)
+{
+    if (strcmp(target->address, upstream->address) != 0)
+    {
+        // Otro agente en esta posición (se recargó la configuración)
+        snprintf(target->address, sizeof(target->address), "%s", upstream->address);
+        target->addr_len = 0;
+        target->resolved_ns = 0;
+    }
+
+    bool retry = target->addr_len == 0 || target->stale;
+    int64_t period_ns = (int64_t)(retry ? AGGREGATE_RESOLVE_RETRY_S : AGGREGATE_RESOLVE_TTL_S) * 1000000000;
+    if (target->resolved_ns > 0 && now - target->resolved_ns < period_ns)
+    {
+        return target->addr_len > 0;
+    }
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_NUMERICSERV};
+    struct addrinfo* result = NULL;
+    int error = getaddrinfo(upstream->host, upstream->port, &hints, &result);
+    target->resolved_ns = now;
+    if (error != 0)
+    {
+        fprintf(stderr, "Could not resolve %s: %s\n", upstream->address, gai_strerror(error));
+        return target->addr_len > 0;
+    }
+
+    memcpy(&target->addr, result->ai_addr, result->ai_addrlen);
+    target->addr_len = result->ai_addrlen;
+    target->stale = false;
+    freeaddrinfo(result);
+
+    return true;
+}
+
+/**
+ * @brief Comienza a conectarse a un agente sin bloquear.
+ */
+static void start_target(target_t* target, const config_upstream_t* upstream, int64_t now, int timeout_ms)
+{
+    target->fd = -1;
+    target->phase = TARGET_FAILED;
+    target->started_ns = now;
+    target->deadline_ns = now + (int64_t)timeout_ms * 1000000;
+    target->duration = 0;
+    target->sent = 0;
+    target->received = 0;
+    target->block_count = 0;
+    target->dropped_families = 0;
+
+    if (!resolve_target(target, upstream, now))
+    {
+        return; // Se cuenta en aggregate_unresolved_upstreams y se reintenta más adelante
+    }
+    if (target->response == NULL && (target->response = malloc(AGGREGATE_RESPONSE_MAX)) == NULL)
+    {
+        fprintf(stderr, "Error allocating the response buffer for %s\n", upstream->address);
+        return;
+    }
+
+    target->request_length = snprintf(target->request, sizeof(target->request),
+                                      "GET /metrics HTTP/1.0\r\nHost: %s\r\nAccept: text/plain; version=0.0.4\r\n"
+                                      "Connection: close\r\n\r\n",
+                                      upstream->address);
+
+    target->fd = socket(target->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (target->fd < 0)
+    {
+        return;
+    }
+
+    if (connect(target->fd, (const struct sockaddr*)&target->addr, target->addr_len) == 0)
+    {
+        target->phase = TARGET_SENDING;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        target->phase = TARGET_CONNECTING;
+    }
+    else
+    {
+        finish_target(target, TARGET_FAILED);
+    }
+}
+
+/**
+ * @brief Indica si @p name es una muestra de la familia de @p block (por ejemplo name_sum).
+ */
+static bool is_sample_of(const family_block_t* block, const char* name, size_t length)
+{
+    static const char* const suffixes[] = {"", "_sum", "_count", "_bucket", "_total", "_created"};
+
+    if (length < block->name_length || strncmp(name, block->name, block->name_length) != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+    {
+        if (strlen(suffixes[i]) == length - block->name_length &&
+            strncmp(name + block->name_length, suffixes[i], length - block->name_length) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Indica si dos bloques pertenecen a la misma familia.
+ */
+static bool same_family(const family_block_t* a, const family_block_t* b)
+{
+    return a->name_length == b->name_length && strncmp(a->name, b->name, a->name_length) == 0;
+}
+
+/**
+ * @brief Busca un bloque anterior de la misma familia que @p block en la respuesta de un agente.
+ *
+ * @return El primer bloque de esa familia, o NULL si @p block es el primero.
+ */
+static const family_block_t* find_earlier_block(const target_t* target, const family_block_t* block)
+{
+    for (const family_block_t* earlier = target->blocks; earlier < block; earlier++)
+    {
+        if (same_family(earlier, block))
+        {
+            return earlier;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Divide una exposición de texto en bloques de líneas contiguas por familia.
+ */
+static void split_families(target_t* target, const char* body)
+{
+    family_block_t* block = NULL;
+    family_block_t overflow; // Familia en curso cuando ya no hay lugar en blocks
+
+    for (const char* line = body; *line != '\0';)
+    {
+        const char* next = strchr(line, '\n');
+        next = next != NULL ? next + 1 : line + strlen(line);
+
+        const char* name = line;
+        bool header = strncmp(line, "# HELP ", 7) == 0 || strncmp(line, "# TYPE ", 7) == 0;
+        if (header)
+        {
+            name += 7;
+        }
+        else if (line[0] == '#' || line[0] == '\n')
+        {
+            line = next; // Otros comentarios y líneas vacías no se propagan
+            continue;
+        }
+        size_t length = strcspn(name, header ? " \n" : "{ \n");
+
+        bool same = block != NULL && (header ? length == block->name_length && strncmp(name, block->name, length) == 0
+                                             : is_sample_of(block, name, length));
+        if (!same)
+        {
+            if (target->block_count < AGGREGATE_MAX_FAMILIES)
+            {
+                block = &target->blocks[target->block_count++];
+            }
+            else
+            {
+                // Seguir recorriendo para contar las familias descartadas
+                block = &overflow;
+                target->dropped_families++;
+            }
+            block->name = name;
+            block->name_length = length;
+            block->type = NULL;
+            block->type_length = 0;
+            block->start = line;
+
+            // Una familia que reaparece separada de su primer bloque conserva su nombre y su TYPE
+            size_t earlier_count = block == &overflow ? target->block_count : target->block_count - 1;
+            for (size_t i = 0; i < earlier_count; i++)
+            {
+                const family_block_t* earlier = &target->blocks[i];
+                if (header ? same_family(earlier, block) : is_sample_of(earlier, name, length))
+                {
+                    block->name = earlier->name;
+                    block->name_length = earlier->name_length;
+                    block->type = earlier->type;
+                    block->type_length = earlier->type_length;
+                    break;
+                }
+            }
+        }
+        if (strncmp(line, "# TYPE ", 7) == 0)
+        {
+            block->type = name + length + strspn(name + length, " ");
+            block->type_length = strcspn(block->type, " \n");
+        }
+        block->end = next;
+        line = next;
+    }
+
+    if (target->dropped_families > 0)
+    {
+        fprintf(stderr, "Too many metric families, %d dropped\n", target->dropped_families);
+    }
+}
+
+/**
+ * @brief Valida la respuesta completa de un agente y la divide en familias.
+ */
+static void parse_response(target_t* target)
+{
+    target->response[target->received] = '\0';
+
+    int status = 0;
+    const char* body = strstr(target->response, "\r\n\r\n");
+    if (sscanf(target->response, "HTTP/%*u.%*u %d", &status) != 1 || status != 200 || body == NULL)
+    {
+        finish_target(target, TARGET_FAILED);
+        return;
+    }
+
+    split_families(target, body + 4);
+    finish_target(target, TARGET_DONE);
+}
+
+/**
+ * @brief Avanza el scrape de un agente tras un evento de poll().
+ */
+static void advance_target(target_t* target)
+{
+    if (target->phase == TARGET_CONNECTING)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(target->fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0)
+        {
+            finish_target(target, TARGET_FAILED);
+            return;
+        }
+        target->phase = TARGET_SENDING;
+    }
+
+    if (target->phase == TARGET_SENDING)
+    {
+        ssize_t n = send(target->fd, target->request + target->sent, target->request_length - target->sent,
+                         MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                finish_target(target, TARGET_FAILED);
+            }
+            return;
+        }
+        target->sent += n;
+        if (target->sent == target->request_length)
+        {
+            target->phase = TARGET_RECEIVING;
+        }
+        return;
+    }
+
+    if (target->phase == TARGET_RECEIVING)
+    {
+        ssize_t n = recv(target->fd, target->response + target->received,
+                         AGGREGATE_RESPONSE_MAX - 1 - target->received, 0);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                finish_target(target, TARGET_FAILED);
+            }
+            return;
+        }
+        if (n == 0)
+        {
+            parse_response(target); // HTTP/1.0: el agente cierra la conexión al terminar
+            return;
+        }
+        target->received += n;
+        if (target->received == AGGREGATE_RESPONSE_MAX - 1)
+        {
+            fprintf(stderr, "Response larger than %d bytes\n", AGGREGATE_RESPONSE_MAX);
+            finish_target(target, TARGET_FAILED);
+        }
+    }
+}
+
+/**
+ * @brief Scrapea todos los agentes en paralelo, cada uno con su propio plazo.
+ */
+static void scrape_targets(const monitor_config_t* config)
+{
+    int64_t now = platform_now_ns();
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        start_target(&targets[i], &config->upstreams[i], now, config->upstream_timeout_ms);
+    }
+
+    while (1)
+    {
+        now = platform_now_ns();
+        int64_t next_deadline = INT64_MAX;
+        nfds_t count = 0;
+
+        for (int i = 0; i < config->upstream_count; i++)
+        {
+            target_t* target = &targets[i];
+            if (target->phase == TARGET_DONE || target->phase == TARGET_FAILED)
+            {
+                continue;
+            }
+            if (now >= target->deadline_ns)
+            {
+                finish_target(target, TARGET_FAILED); // Venció el plazo del agente
+                continue;
+            }
+
+            poll_fds[count].fd = target->fd;
+            poll_fds[count].events = target->phase == TARGET_RECEIVING ? POLLIN : POLLOUT;
+            poll_targets[count] = i;
+            count++;
+            if (target->deadline_ns < next_deadline)
+            {
+                next_deadline = target->deadline_ns;
+            }
+        }
+        if (count == 0)
+        {
+            return;
+        }
+
+        int timeout_ms = (int)((next_deadline - now + 999999) / 1000000);
+        if (poll(poll_fds, count, timeout_ms) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            for (nfds_t j = 0; j < count; j++)
+            {
+                finish_target(&targets[poll_targets[j]], TARGET_FAILED);
+            }
+            return;
+        }
+
+        for (nfds_t j = 0; j < count; j++)
+        {
+            if (poll_fds[j].revents != 0)
+            {
+                advance_target(&targets[poll_targets[j]]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Agrega @p n bytes a la exposición, si entran.
+ */
+static void put(snapshot_t* out, const char* bytes, size_t n)
+{
+    if (out->data != NULL && out->length <= out->capacity && n <= out->capacity - out->length)
+    {
+        memcpy(out->data + out->length, bytes, n);
+    }
+    out->length += n;
+}
+
+/**
+ * @brief Agrega texto con formato a la exposición, si entra.
+ */
+static void put_format(snapshot_t* out, const char* format, ...)
+{
+    bool room = out->data != NULL && out->length < out->capacity;
+    char* at = room ? out->data + out->length : NULL;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(at, room ? out->capacity - out->length : 0, format, args);
+    va_end(args);
+
+    if (written > 0)
+    {
+        out->length += written;
+    }
+}
+
+/**
+ * @brief Indica si dos bloques de la misma familia declaran el mismo tipo (sin TYPE es untyped).
+ */
+static bool same_type(const family_block_t* a, const family_block_t* b)
+{
+    const char* a_type = a->type != NULL ? a->type : "untyped";
+    const char* b_type = b->type != NULL ? b->type : "untyped";
+    size_t a_length = a->type != NULL ? a->type_length : strlen("untyped");
+    size_t b_length = b->type != NULL ? b->type_length : strlen("untyped");
+
+    return a_length == b_length && strncmp(a_type, b_type, a_length) == 0;
+}
+
+/**
+ * @brief Copia las etiquetas de una muestra a partir de la primera, renombrando instance a
+ * exported_instance para que no choque con la que agrega el agregador.
+ *
+ * @return Bytes de @p labels copiados, hasta la '}' exclusive.
+ */
+static size_t put_labels(snapshot_t* out, const char* labels, size_t length)
+{
+    size_t at = 0;
+
+    while (at < length && labels[at] != '}')
+    {
+        size_t name_length = strcspn(labels + at, "=}\n");
+        if (name_length == strlen("instance") && strncmp(labels + at, "instance", name_length) == 0)
+        {
+            put(out, "exported_", strlen("exported_"));
+        }
+
+        // Nombre, '=' y valor entre comillas, respetando los escapes
+        size_t end = at + name_length;
+        bool quoted = false;
+        for (; end < length && (quoted || (labels[end] != ',' && labels[end] != '}')); end++)
+        {
+            if (labels[end] == '\\' && quoted)
+            {
+                end++;
+            }
+            else if (labels[end] == '"')
+            {
+                quoted = !quoted;
+            }
+        }
+        if (end < length && labels[end] == ',')
+        {
+            end++;
+        }
+        put(out, labels + at, (end < length ? end : length) - at);
+        at = end;
+    }
+
+    return at < length ? at : length;
+}
+
+/**
+ * @brief Copia una muestra agregando la etiqueta instance.
+ */
+static void put_sample(snapshot_t* out, const char* line, size_t length, const char* instance)
+{
+    size_t name_length = strcspn(line, "{ ");
+
+    put(out, line, name_length);
+    if (line[name_length] == '{')
+    {
+        bool empty = line[name_length + 1] == '}';
+        put_format(out, empty ? "{instance=\"%s\"" : "{instance=\"%s\",", instance);
+        name_length++;
+        name_length += put_labels(out, line + name_length, length - name_length);
+    }
+    else
+    {
+        put_format(out, "{instance=\"%s\"}", instance);
+    }
+    put(out, line + name_length, length - name_length);
+    if (line[length - 1] != '\n')
+    {
+        put(out, "\n", 1);
+    }
+}
+
+/**
+ * @brief Fusiona las respuestas de los agentes en una exposición de texto.
+ *
+ * Cada familia aparece una sola vez, con el HELP y el TYPE del primer agente que la
+ * expone, seguida de las muestras de todos los agentes que declaran ese mismo TYPE. Las
+ * familias que no entran o cuyo TYPE difiere se cuentan por agente.
+ */
+static void merge_targets(const monitor_config_t* config, snapshot_t* out)
+{
+    size_t family_count = 0;
+
+    out->length = 0;
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        dropped_families[i] = targets[i].phase == TARGET_DONE ? targets[i].dropped_families : 0;
+        type_conflicts[i] = 0;
+
+        for (size_t b = 0; b < targets[i].block_count && targets[i].phase == TARGET_DONE; b++)
+        {
+            if (find_earlier_block(&targets[i], &targets[i].blocks[b]) != NULL)
+            {
+                continue; // Otro bloque de una familia ya vista en este agente
+            }
+
+            bool known = false;
+            for (size_t f = 0; f < family_count && !known; f++)
+            {
+                known = same_family(&merged_families[f], &targets[i].blocks[b]);
+            }
+            if (!known && family_count < AGGREGATE_MAX_FAMILIES)
+            {
+                merged_families[family_count++] = targets[i].blocks[b];
+            }
+            else if (!known)
+            {
+                dropped_families[i]++;
+            }
+        }
+    }
+
+    for (size_t f = 0; f < family_count; f++)
+    {
+        bool header_written = false;
+        for (int i = 0; i < config->upstream_count; i++)
+        {
+            // Una familia puede estar partida en varios bloques no contiguos: se fusionan todos
+            bool conflict = false;
+            for (size_t b = 0; b < targets[i].block_count && targets[i].phase == TARGET_DONE; b++)
+            {
+                const family_block_t* block = &targets[i].blocks[b];
+                if (!same_family(block, &merged_families[f]))
+                {
+                    continue;
+                }
+                if (!same_type(block, &merged_families[f]))
+                {
+                    conflict = true; // Mezclar muestras de otro tipo bajo el TYPE fusionado las corrompería
+                    continue;
+                }
+
+                for (const char* line = block->start; line < block->end;)
+                {
+                    const char* next = memchr(line, '\n', block->end - line);
+                    next = next != NULL ? next + 1 : block->end;
+                    if (line[0] != '#')
+                    {
+                        put_sample(out, line, next - line, config->upstreams[i].address);
+                    }
+                    else if (!header_written)
+                    {
+                        put(out, line, next - line);
+                    }
+                    line = next;
+                }
+                header_written = true;
+            }
+            type_conflicts[i] += conflict;
+        }
+    }
+
+    put_format(out, "# HELP aggregate_upstream_up Whether the last scrape of the agent succeeded\n"
+                    "# TYPE aggregate_upstream_up gauge\n");
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        put_format(out, "aggregate_upstream_up{instance=\"%s\"} %d\n", config->upstreams[i].address,
+                   targets[i].phase == TARGET_DONE);
+    }
+    int unresolved = 0;
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        unresolved += targets[i].addr_len == 0;
+    }
+    put_format(out, "# HELP aggregate_unresolved_upstreams Agents skipped because their address could not be resolved\n"
+                    "# TYPE aggregate_unresolved_upstreams gauge\n"
+                    "aggregate_unresolved_upstreams %d\n",
+               unresolved);
+    put_format(out, "# HELP aggregate_upstream_scrape_duration_seconds Duration of the last scrape of the agent\n"
+                    "# TYPE aggregate_upstream_scrape_duration_seconds gauge\n");
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        put_format(out, "aggregate_upstream_scrape_duration_seconds{instance=\"%s\"} %.6f\n",
+                   config->upstreams[i].address, targets[i].duration);
+    }
+    put_format(out, "# HELP aggregate_upstream_dropped_families Families of the agent left out of the last merge "
+                    "because there were more than %d\n"
+                    "# TYPE aggregate_upstream_dropped_families gauge\n",
+               AGGREGATE_MAX_FAMILIES);
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        put_format(out, "aggregate_upstream_dropped_families{instance=\"%s\"} %d\n", config->upstreams[i].address,
+                   dropped_families[i]);
+    }
+    put_format(out, "# HELP aggregate_upstream_type_conflicts Families of the agent left out of the last merge "
+                    "because their TYPE differs from another agent's\n"
+                    "# TYPE aggregate_upstream_type_conflicts gauge\n");
+    for (int i = 0; i < config->upstream_count; i++)
+    {
+        put_format(out, "aggregate_upstream_type_conflicts{instance=\"%s\"} %d\n", config->upstreams[i].address,
+                   type_conflicts[i]);
+    }
+}
+
+/**
+ * @brief Scrapea los agentes y publica la exposición fusionada.
+ *
+ * La exposición se construye en un buffer que no se está enviando; si no hay ninguno
+ * libre se conserva la anterior. Los buffers sólo crecen, de modo que en régimen
+ * estable no se asigna memoria.
+ */
+static void run_refresh(const monitor_config_t* config)
+{
+    snapshot_t* out = NULL;
+
+    pthread_mutex_lock(&aggregate_lock);
+    for (int i = 0; i < AGGREGATE_SNAPSHOTS && out == NULL; i++)
+    {
+        if (snapshots[i].refs == 0)
+        {
+            out = &snapshots[i];
+            out->refs = 1; // Reservado mientras se construye
+        }
+    }
+    pthread_mutex_unlock(&aggregate_lock);
+
+    if (out == NULL)
+    {
+        fprintf(stderr, "All aggregate buffers are being sent, keeping the previous exposition\n");
+        return;
+    }
+
+    scrape_targets(config);
+
+    merge_targets(config, out);
+    if (out->length >= out->capacity)
+    {
+        size_t capacity = out->length + 1 > 2 * out->capacity ? out->length + 1 : 2 * out->capacity;
+        char* data = realloc(out->data, capacity);
+        if (data == NULL)
+        {
+            fprintf(stderr, "Error allocating the aggregate buffer\n");
+            pthread_mutex_lock(&aggregate_lock);
+            out->refs = 0;
+            pthread_mutex_unlock(&aggregate_lock);
+            return;
+        }
+        out->data = data;
+        out->capacity = capacity;
+        merge_targets(config, out);
+    }
+
+    pthread_mutex_lock(&aggregate_lock);
+    snapshot_t* previous = current_snapshot;
+    current_snapshot = out; // La referencia de la construcción pasa a ser la de la exposición actual
+    if (previous != NULL)
+    {
+        previous->refs--;
+    }
+    pthread_mutex_unlock(&aggregate_lock);
+}
+
+void aggregate_refresh(const monitor_config_t* config, int min_age_ms)
+{
+    pthread_mutex_lock(&aggregate_lock);
+
+    if (refreshing)
+    {
+        // Sumarse a la actualización en curso en lugar de iniciar otra
+        unsigned long pending = generation;
+        while (generation == pending)
+        {
+            pthread_cond_wait(&aggregate_done, &aggregate_lock);
+        }
+        pthread_mutex_unlock(&aggregate_lock);
+        return;
+    }
+
+    if (generation > 0 && platform_now_ns() - last_refresh_ns < (int64_t)min_age_ms * 1000000)
+    {
+        pthread_mutex_unlock(&aggregate_lock); // La exposición en caché es suficientemente reciente
+        return;
+    }
+
+    refreshing = true;
+    pthread_mutex_unlock(&aggregate_lock);
+
+    run_refresh(config);
+
+    pthread_mutex_lock(&aggregate_lock);
+    refreshing = false;
+    generation++;
+    last_refresh_ns = platform_now_ns();
+    pthread_cond_broadcast(&aggregate_done);
+    pthread_mutex_unlock(&aggregate_lock);
+}
+
+char* aggregate_acquire(size_t* length)
+{
+    char* data = NULL;
+
+    pthread_mutex_lock(&aggregate_lock);
+    if (current_snapshot != NULL)
+    {
+        current_snapshot->refs++;
+        data = current_snapshot->data;
+        *length = current_snapshot->length;
+    }
+    pthread_mutex_unlock(&aggregate_lock);
+
+    return data;
+}
+
+void aggregate_release(void* data)
+{
+    pthread_mutex_lock(&aggregate_lock);
+    for (int i = 0; i < AGGREGATE_SNAPSHOTS; i++)
+    {
+        if (snapshots[i].data == data && snapshots[i].refs > 0)
+        {
+            snapshots[i].refs--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&aggregate_lock);
+}
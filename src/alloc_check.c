@@ -0,0 +1,76 @@
+#include "../include/alloc_check.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/** Implementaciones de glibc a las que delega el interpositor */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+/** Indica si se están contando asignaciones */
+static atomic_bool counting;
+
+/** Asignaciones contadas desde alloc_check_start() */
+static atomic_size_t allocations;
+
+/**
+ * @brief Cuenta una asignación si la medición está activa.
+ */
+static void count_allocation()
+{
+    if (atomic_load_explicit(&counting, memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    }
+}
+
+void alloc_check_start()
+{
+    atomic_store(&allocations, 0);
+    atomic_store(&counting, true);
+}
+
+size_t alloc_check_stop()
+{
+    atomic_store(&counting, false);
+    return atomic_load(&allocations);
+}
+
+void* malloc(size_t size)
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    count_allocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr != NULL ? 0 : ENOMEM;
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
@@ -0,0 +1,58 @@
+#include "../include/arena.h"
+#include <stdlib.h>
+
+int arena_init(arena_t* arena, size_t capacity)
+{
+    arena->base = malloc(capacity);
+    if (arena->base == NULL)
+    {
+        return -1;
+    }
+
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->high_water = 0;
+
+    return 0;
+}
+
+void arena_destroy(arena_t* arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size)
+{
+    size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    if (start > arena->capacity || size > arena->capacity - start)
+    {
+        return NULL;
+    }
+
+    arena_commit(arena, start + size - arena->used);
+    return arena->base + start;
+}
+
+char* arena_reserve(arena_t* arena, size_t* available)
+{
+    *available = arena->capacity - arena->used;
+    return arena->base + arena->used;
+}
+
+void arena_commit(arena_t* arena, size_t size)
+{
+    arena->used += size;
+    if (arena->used > arena->high_water)
+    {
+        arena->high_water = arena->used;
+    }
+}
+
+void arena_reset(arena_t* arena)
+{
+    arena->used = 0;
+}
@@ -0,0 +1,290 @@
+#include "../include/collector.h"
+#include "../include/expose_metrics.h"
+#include "../include/platform.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Función de actualización de cada grupo de métricas, indexada por metric_group_t (NULL si tiene su propio hilo) */
+static void (*const group_updaters[METRIC_GROUP_COUNT])() = {
+    [METRIC_GROUP_CPU] = update_cpu_gauge,
+    [METRIC_GROUP_MEMORY] = update_memory_gauge,
+    [METRIC_GROUP_DISK_IO] = update_disk_io_gauge,
+    [METRIC_GROUP_NETWORK] = update_network_gauge,
+    [METRIC_GROUP_PROCESS_COUNT] = update_process_count_gauge,
+    [METRIC_GROUP_CONTEXT_SWITCHES] = update_context_switches_gauge,
+    [METRIC_GROUP_PERF_EVENTS] = update_perf_events_gauge,
+    [METRIC_GROUP_PROC_EVENTS] = update_proc_events_gauge,
+    [METRIC_GROUP_SCHEDSTAT] = update_schedstat_gauge,
+};
+
+/** Protege el estado de los ciclos de recolección */
+static pthread_mutex_t collect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Señala el fin de un ciclo a los pedidos que esperan */
+static pthread_cond_t collect_done = PTHREAD_COND_INITIALIZER;
+
+/** Indica si hay un ciclo en curso */
+static bool collecting;
+
+/** Indica si hay una reconciliación en curso; mientras tanto no empieza ningún ciclo */
+static bool reconciling;
+
+/** Cantidad de ciclos terminados */
+static unsigned long generation;
+
+/** Instante (CLOCK_MONOTONIC) en que terminó el último ciclo */
+static struct timespec last_collect;
+
+/**
+ * @brief Milisegundos transcurridos desde @p since.
+ */
+static long elapsed_ms(const struct timespec* since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+/** Período vigente de cada grupo en milisegundos, o 0 si hay que recolectarlo ya */
+static int group_periods[METRIC_GROUP_COUNT];
+
+/** Próximo instante (CLOCK_MONOTONIC, en nanosegundos) en que vence cada grupo */
+static int64_t group_deadlines[METRIC_GROUP_COUNT];
+
+/** Modo e intervalo con que se programaron los períodos vigentes */
+static bool scheduled_adaptive;
+static int scheduled_interval;
+
+/**
+ * @brief Actualiza las métricas de los grupos habilitados marcados en @p due.
+ */
+static void run_collection(const monitor_config_t* config, const bool due[METRIC_GROUP_COUNT])
+{
+    metrics_tick_reset(); // Reutilizar la arena del ciclo anterior
+
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        if (due[group] && config->enabled[group] && group_updaters[group] != NULL)
+        {
+            group_updaters[group]();
+        }
+    }
+}
+
+/**
+ * @brief Reserva el ciclo de recolección.
+ *
+ * @return true si el llamador debe recolectar; false si se sumó a un ciclo en curso o si
+ *         los valores publicados tienen menos de @p min_age_ms milisegundos.
+ */
+static bool begin_collection(int min_age_ms)
+{
+    pthread_mutex_lock(&collect_lock);
+
+    while (reconciling)
+    {
+        pthread_cond_wait(&collect_done, &collect_lock);
+    }
+
+    if (collecting)
+    {
+        // Sumarse al ciclo en curso en lugar de iniciar otro
+        unsigned long pending = generation;
+        while (generation == pending)
+        {
+            pthread_cond_wait(&collect_done, &collect_lock);
+        }
+        pthread_mutex_unlock(&collect_lock);
+        return false;
+    }
+
+    if (generation > 0 && elapsed_ms(&last_collect) < min_age_ms)
+    {
+        pthread_mutex_unlock(&collect_lock); // Los valores publicados son suficientemente recientes
+        return false;
+    }
+
+    collecting = true;
+    pthread_mutex_unlock(&collect_lock);
+    return true;
+}
+
+/**
+ * @brief Termina el ciclo reservado con begin_collection() y despierta a quienes esperan.
+ */
+static void end_collection()
+{
+    pthread_mutex_lock(&collect_lock);
+    collecting = false;
+    generation++;
+    clock_gettime(CLOCK_MONOTONIC, &last_collect);
+    pthread_cond_broadcast(&collect_done);
+    pthread_mutex_unlock(&collect_lock);
+}
+
+void reconcile_collection(const monitor_config_t* config)
+{
+    // Las interfaces del kernel se abren y cierran sin ningún ciclo leyéndolas
+    pthread_mutex_lock(&collect_lock);
+    while (collecting || reconciling)
+    {
+        pthread_cond_wait(&collect_done, &collect_lock);
+    }
+    reconciling = true;
+    pthread_mutex_unlock(&collect_lock);
+
+    reconcile_metrics(config);
+
+    pthread_mutex_lock(&collect_lock);
+    reconciling = false;
+    pthread_cond_broadcast(&collect_done);
+    pthread_mutex_unlock(&collect_lock);
+}
+
+void collect_metrics(int min_age_ms)
+{
+    bool all_groups[METRIC_GROUP_COUNT];
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        all_groups[group] = true;
+    }
+
+    if (begin_collection(min_age_ms))
+    {
+        const monitor_config_t* config = config_acquire();
+        run_collection(config, all_groups);
+        config_release(config);
+        end_collection();
+    }
+}
+
+/**
+ * @brief Calcula el próximo período de un grupo que acaba de recolectarse.
+ *
+ * En modo adaptativo el período se reduce a la mitad si el grupo cambió más de
+ * adaptive_change_pct por ciento desde la muestra anterior, y si no crece un 25%;
+ * así reacciona enseguida a un pico y vuelve de a poco al máximo cuando se estabiliza.
+ */
+static int next_period(const monitor_config_t* config, metric_group_t group)
+{
+    double change = take_group_change(group);
+    int period = group_periods[group];
+
+    if (!config->adaptive)
+    {
+        return config->interval * 1000;
+    }
+    if (period == 0)
+    {
+        period = config->interval * 1000; // Primer ciclo: partir del intervalo configurado
+    }
+    else if (change * 100 > config->adaptive_change_pct)
+    {
+        period /= 2;
+    }
+    else
+    {
+        period += period >= 4 ? period / 4 : 1;
+    }
+
+    if (period < config->adaptive_min_ms)
+    {
+        period = config->adaptive_min_ms;
+    }
+    if (period > config->adaptive_max_ms)
+    {
+        period = config->adaptive_max_ms;
+    }
+    return period;
+}
+
+int collect_scheduled_metrics()
+{
+    const monitor_config_t* config = config_acquire();
+    int64_t now = platform_now_ns();
+
+    if (config->adaptive != scheduled_adaptive || config->interval != scheduled_interval)
+    {
+        // Cambió el modo o el intervalo: reprogramar todos los grupos desde cero
+        for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+        {
+            group_periods[group] = 0;
+        }
+        scheduled_adaptive = config->adaptive;
+        scheduled_interval = config->interval;
+    }
+
+    bool due[METRIC_GROUP_COUNT] = {false};
+    bool any_due = false;
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        if (!config->enabled[group] || group_updaters[group] == NULL || !group_available(group))
+        {
+            group_periods[group] = 0; // Al habilitarse o abrirse se recolecta de inmediato
+            continue;
+        }
+        due[group] = group_periods[group] == 0 || now >= group_deadlines[group];
+        any_due |= due[group];
+    }
+
+    if (any_due && begin_collection(0))
+    {
+        run_collection(config, due);
+        end_collection();
+    }
+
+    int timeout_ms = config->adaptive ? config->adaptive_max_ms : config->interval * 1000;
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        double hertz = 0;
+        if (group == METRIC_GROUP_STREAM_STATS)
+        {
+            hertz = config->enabled[group] ? 1000.0 / config->stats_sample_ms : 0;
+        }
+        else if (due[group])
+        {
+            group_periods[group] = next_period(config, group);
+            group_deadlines[group] = now + (int64_t)group_periods[group] * 1000000;
+        }
+        if (group_periods[group] > 0)
+        {
+            hertz = 1000.0 / group_periods[group];
+            // Redondear hacia arriba
+            int64_t remaining_ms = (group_deadlines[group] - platform_now_ns() + 999999) / 1000000;
+            if (remaining_ms < timeout_ms)
+            {
+                timeout_ms = remaining_ms > 0 ? (int)remaining_ms : 0;
+            }
+        }
+        update_sample_rate_gauge(group, hertz);
+    }
+    config_release(config);
+
+    return timeout_ms;
+}
+
+void prime_metrics()
+{
+    metrics_tick_reset();
+    prime_cpu_usage();
+    prime_schedstat_gauge();
+
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = COLLECTOR_PRIME_DELAY_MS * 1000000L};
+    nanosleep(&delay, NULL);
+
+    const monitor_config_t* config = config_acquire();
+    bool on_scrape = config->collect_on_scrape || config->upstream_count > 0;
+    config_release(config);
+
+    if (on_scrape)
+    {
+        collect_metrics(0);
+    }
+    else
+    {
+        collect_scheduled_metrics();
+    }
+}
@@ -0,0 +1,410 @@
+#include "../include/config.h"
+#include "../include/arena.h"
+#include <cjson/cJSON.h>
+#include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/** Claves JSON de cada grupo de métricas, en el orden de metric_group_t */
+static const char* const group_keys[METRIC_GROUP_COUNT] = {
+    "cpu", "memory", "disk_io", "network_stats", "process_count", "context_switches", "stream_stats",
+    "perf_events", "proc_events", "schedstat",
+};
+
+/**
+ * Grupos que sólo se habilitan explícitamente: requieren privilegios (perf_events,
+ * proc_events) o tienen un costo propio (un hilo de muestreo, recorrer /proc)
+ */
+static const bool group_opt_in[METRIC_GROUP_COUNT] = {
+    [METRIC_GROUP_STREAM_STATS] = true,
+    [METRIC_GROUP_PERF_EVENTS] = true,
+    [METRIC_GROUP_PROC_EVENTS] = true,
+    [METRIC_GROUP_SCHEDSTAT] = true,
+};
+
+/** Configuración publicada actualmente */
+static monitor_config_t* current_config = NULL;
+
+/** Protege la lectura del puntero junto con el incremento de su contador de referencias */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Arena para el texto del archivo y los nodos de cJSON; se reutiliza entre recargas */
+static arena_t parse_arena;
+
+/** Nombre (sin directorio) del archivo vigilado con inotify */
+static char watched_name[NAME_MAX + 1];
+
+const char* config_group_key(metric_group_t group)
+{
+    return group_keys[group];
+}
+
+monitor_config_t* config_defaults()
+{
+    monitor_config_t* config = calloc(1, sizeof(*config));
+    if (config == NULL)
+    {
+        return NULL;
+    }
+
+    config->interval = CONFIG_DEFAULT_INTERVAL;
+    config->stats_sample_ms = CONFIG_DEFAULT_STATS_SAMPLE_MS;
+    config->stats_window_s = CONFIG_DEFAULT_STATS_WINDOW_S;
+    config->adaptive_min_ms = CONFIG_DEFAULT_ADAPTIVE_MIN_MS;
+    config->adaptive_max_ms = CONFIG_DEFAULT_ADAPTIVE_MAX_MS;
+    config->adaptive_change_pct = CONFIG_DEFAULT_ADAPTIVE_CHANGE_PCT;
+    config->upstream_timeout_ms = CONFIG_DEFAULT_UPSTREAM_TIMEOUT_MS;
+    for (int i = 0; i < METRIC_GROUP_COUNT; i++)
+    {
+        config->enabled[i] = !group_opt_in[i];
+    }
+    atomic_init(&config->refs, 1);
+
+    return config;
+}
+
+/**
+ * @brief Asignador de cJSON sobre la arena de parseo.
+ */
+static void* parse_alloc(size_t size)
+{
+    return arena_alloc(&parse_arena, size);
+}
+
+/**
+ * @brief Los nodos de cJSON se liberan todos juntos al reiniciar la arena.
+ */
+static void parse_free(void* ptr)
+{
+    (void)ptr;
+}
+
+/**
+ * @brief Lee el archivo completo en la arena de parseo, terminado en '\0'.
+ *
+ * La arena sólo se vuelve a reservar si el archivo creció más allá de su capacidad.
+ *
+ * @param config_filename Ruta del archivo.
+ * @return Contenido del archivo, o NULL en caso de error.
+ */
+static char* read_file(const char* config_filename)
+{
+    FILE* file = fopen(config_filename, "r");
+    if (file == NULL)
+    {
+        perror("Error al abrir el archivo de configuración");
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    size_t needed = length >= 0 ? (size_t)length * CONFIG_PARSE_FACTOR + CONFIG_PARSE_MIN : 0;
+    if (needed > parse_arena.capacity)
+    {
+        arena_destroy(&parse_arena);
+        if (arena_init(&parse_arena, needed) != 0)
+        {
+            needed = 0;
+        }
+    }
+    arena_reset(&parse_arena);
+
+    char* data = needed > 0 ? arena_alloc(&parse_arena, length + 1) : NULL;
+    if (data == NULL || fread(data, 1, length, file) != (size_t)length)
+    {
+        fprintf(stderr, "Error al leer el archivo de configuración\n");
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    data[length] = '\0';
+
+    return data;
+}
+
+/**
+ * @brief Lee una clave booleana opcional; si falta, conserva el valor por defecto.
+ *
+ * @return false si la clave existe y no es booleana.
+ */
+static bool read_optional_bool(const cJSON* json, const char* key, bool* value)
+{
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(json, key);
+    if (item == NULL)
+    {
+        return true;
+    }
+    if (!cJSON_IsBool(item))
+    {
+        fprintf(stderr, "\"%s\" debe ser true o false\n", key);
+        return false;
+    }
+
+    *value = cJSON_IsTrue(item);
+    return true;
+}
+
+/**
+ * @brief Lee una clave entera opcional dentro de [min, max]; si falta, conserva el valor por defecto.
+ *
+ * @return false si la clave existe y no es un número dentro del rango.
+ */
+static bool read_optional_int(const cJSON* json, const char* key, int min, int max, int* value)
+{
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(json, key);
+    if (item == NULL)
+    {
+        return true;
+    }
+    if (!cJSON_IsNumber(item) || item->valuedouble < min || item->valuedouble > max)
+    {
+        fprintf(stderr, "\"%s\" debe ser un número entre %d y %d\n", key, min, max);
+        return false;
+    }
+
+    *value = item->valueint;
+    return true;
+}
+
+/**
+ * @brief Valida una dirección "host:puerto" (o "[ipv6]:puerto") y la separa en host y puerto.
+ *
+ * No la resuelve: eso lo hace el agregador en cada scrape que lo necesite, de modo que un
+ * agente que todavía no está en el DNS no invalida la configuración.
+ *
+ * @return false si la dirección está mal formada.
+ */
+static bool parse_upstream(const char* address, config_upstream_t* upstream)
+{
+    const char* colon = strrchr(address, ':');
+    size_t length = strlen(address);
+    const char* port = colon != NULL ? colon + 1 : "";
+    size_t port_length = strlen(port);
+    if (colon == NULL || colon == address || port_length == 0 || port_length >= sizeof(upstream->port) ||
+        strspn(port, "0123456789") != port_length || atoi(port) < 1 || atoi(port) > 65535 ||
+        length >= sizeof(upstream->address) || strpbrk(address, "\"\\") != NULL)
+    {
+        fprintf(stderr, "Agente inválido \"%s\": se espera \"host:puerto\"\n", address);
+        return false;
+    }
+
+    const char* start = address;
+    size_t host_length = colon - address;
+    if (address[0] == '[' && colon[-1] == ']')
+    {
+        start++;
+        host_length -= 2;
+    }
+
+    snprintf(upstream->address, sizeof(upstream->address), "%s", address);
+    snprintf(upstream->host, sizeof(upstream->host), "%.*s", (int)host_length, start);
+    snprintf(upstream->port, sizeof(upstream->port), "%s", port);
+
+    return true;
+}
+
+/**
+ * @brief Lee la lista opcional "upstreams" de agentes a agregar.
+ *
+ * @return false si la clave existe y no es un arreglo de direcciones válidas.
+ */
+static bool read_upstreams(const cJSON* json, monitor_config_t* config)
+{
+    const cJSON* list = cJSON_GetObjectItemCaseSensitive(json, "upstreams");
+    if (list == NULL)
+    {
+        return true;
+    }
+    if (!cJSON_IsArray(list) || cJSON_GetArraySize(list) > CONFIG_MAX_UPSTREAMS)
+    {
+        fprintf(stderr, "\"upstreams\" debe ser un arreglo de hasta %d direcciones\n", CONFIG_MAX_UPSTREAMS);
+        return false;
+    }
+
+    const cJSON* item;
+    cJSON_ArrayForEach(item, list)
+    {
+        if (!cJSON_IsString(item) || !parse_upstream(item->valuestring, &config->upstreams[config->upstream_count]))
+        {
+            return false;
+        }
+        config->upstream_count++;
+    }
+
+    return true;
+}
+
+monitor_config_t* config_load(const char* config_filename)
+{
+    char* data = read_file(config_filename);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+
+    cJSON_Hooks hooks = {.malloc_fn = parse_alloc, .free_fn = parse_free};
+    cJSON_InitHooks(&hooks);
+
+    monitor_config_t* config = NULL;
+    cJSON* json = cJSON_Parse(data);
+    if (json == NULL)
+    {
+        fprintf(stderr, "Error al parsear el archivo JSON de configuración\n");
+        goto out;
+    }
+
+    cJSON* metrics_json = cJSON_GetObjectItemCaseSensitive(json, "metrics");
+    cJSON* interval_json = cJSON_GetObjectItemCaseSensitive(json, "interval");
+
+    if (!cJSON_IsObject(metrics_json) || !cJSON_IsNumber(interval_json))
+    {
+        fprintf(stderr, "Formato de archivo JSON inválido: se esperan \"metrics\" e \"interval\"\n");
+        goto out;
+    }
+
+    if (interval_json->valuedouble < 1 || interval_json->valuedouble > CONFIG_MAX_INTERVAL)
+    {
+        fprintf(stderr, "Intervalo inválido: debe estar entre 1 y %d segundos\n", CONFIG_MAX_INTERVAL);
+        goto out;
+    }
+
+    config = config_defaults();
+    if (config == NULL)
+    {
+        goto out;
+    }
+    config->interval = interval_json->valueint;
+
+    // Las métricas ausentes conservan el valor de config_defaults(), igual que sin archivo
+    for (int i = 0; i < METRIC_GROUP_COUNT; i++)
+    {
+        if (!read_optional_bool(metrics_json, group_keys[i], &config->enabled[i]))
+        {
+            free(config);
+            config = NULL;
+            goto out;
+        }
+    }
+
+    if (!read_optional_bool(json, "collect_on_scrape", &config->collect_on_scrape) ||
+        !read_optional_int(json, "scrape_min_age_ms", 0, CONFIG_MAX_SCRAPE_MIN_AGE_MS, &config->scrape_min_age_ms) ||
+        !read_optional_int(json, "stats_sample_ms", 1, CONFIG_MAX_STATS_SAMPLE_MS, &config->stats_sample_ms) ||
+        !read_optional_int(json, "stats_window_s", 1, CONFIG_MAX_STATS_WINDOW_S, &config->stats_window_s) ||
+        !read_optional_bool(json, "adaptive", &config->adaptive) ||
+        !read_optional_int(json, "adaptive_min_ms", 1, CONFIG_MAX_ADAPTIVE_MS, &config->adaptive_min_ms) ||
+        !read_optional_int(json, "adaptive_max_ms", 1, CONFIG_MAX_ADAPTIVE_MS, &config->adaptive_max_ms) ||
+        !read_optional_int(json, "adaptive_change_pct", 1, 1000, &config->adaptive_change_pct) ||
+        !read_optional_int(json, "upstream_timeout_ms", 1, CONFIG_MAX_UPSTREAM_TIMEOUT_MS,
+                           &config->upstream_timeout_ms) ||
+        !read_optional_int(json, "proc_events_ring", 0, CONFIG_MAX_PROC_EVENTS_RING, &config->proc_events_ring) ||
+        !read_optional_int(json, "schedstat_top_tasks", 0, CONFIG_MAX_SCHEDSTAT_TOP_TASKS,
+                           &config->schedstat_top_tasks) ||
+        !read_upstreams(json, config))
+    {
+        free(config);
+        config = NULL;
+        goto out;
+    }
+
+    if (config->adaptive_min_ms > config->adaptive_max_ms)
+    {
+        fprintf(stderr, "\"adaptive_min_ms\" no puede superar a \"adaptive_max_ms\"\n");
+        free(config);
+        config = NULL;
+        goto out;
+    }
+
+out:
+    cJSON_Delete(json);
+    cJSON_InitHooks(NULL);
+    arena_reset(&parse_arena);
+    return config;
+}
+
+void config_publish(monitor_config_t* config)
+{
+    pthread_mutex_lock(&config_lock);
+    monitor_config_t* previous = current_config;
+    current_config = config;
+    pthread_mutex_unlock(&config_lock);
+
+    config_release(previous);
+}
+
+const monitor_config_t* config_acquire()
+{
+    pthread_mutex_lock(&config_lock);
+    monitor_config_t* config = current_config;
+    if (config != NULL)
+    {
+        atomic_fetch_add(&config->refs, 1);
+    }
+    pthread_mutex_unlock(&config_lock);
+
+    return config;
+}
+
+void config_release(const monitor_config_t* config)
+{
+    monitor_config_t* mutable_config = (monitor_config_t*)config;
+
+    if (mutable_config != NULL && atomic_fetch_sub(&mutable_config->refs, 1) == 1)
+    {
+        free(mutable_config);
+    }
+}
+
+int config_watch_init(const char* config_filename)
+{
+    char path[PATH_MAX];
+
+    // basename() y dirname() pueden modificar su argumento, se trabaja sobre copias
+    snprintf(path, sizeof(path), "%s", config_filename);
+    snprintf(watched_name, sizeof(watched_name), "%s", basename(path));
+    snprintf(path, sizeof(path), "%s", config_filename);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("Error al inicializar inotify");
+        return -1;
+    }
+
+    if (inotify_add_watch(fd, dirname(path), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        perror("Error al vigilar el directorio de configuración");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool config_watch_changed(int fd)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+
+    while ((length = read(fd, events, sizeof(events))) > 0)
+    {
+        for (char* ptr = events; ptr < events + length;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            if (event->len > 0 && strcmp(event->name, watched_name) == 0)
+            {
+                changed = true;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
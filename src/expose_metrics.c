@@ -1,44 +1,291 @@
 #include "expose_metrics.h"
+#include "aggregator.h"
+#include "collector.h"
+#include "perf_events.h"
+#include "proc_events.h"
+#include "schedstat.h"
+#include "sampler.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 /** Mutex for thread synchronization */
 pthread_mutex_t lock;
 
-/** Métric from Prometheus for the CPU usage */
-static prom_gauge_t* cpu_usage_metric;
+/** Identifiers of every metric exported by the agent */
+enum metric_id
+{
+    CPU_USAGE,
+    MEMORY_USAGE,
+    DISK_IO_READS,
+    DISK_IO_WRITES,
+    RX_BYTES,
+    TX_BYTES,
+    RX_ERRORS,
+    TX_ERRORS,
+    COLLISIONS,
+    PROCESS_COUNT,
+    CONTEXT_SWITCHES,
+    METRIC_COUNT
+};
+
+/** Static description of a metric: the group that enables it, its name, its help text and
+ * whether it is a running total (its rate of change is what matters) or a level. The
+ * baseline metrics in metric_defs are exposed as gauges either way, under their original
+ * names; the newer per-CPU families register their running totals as counters */
+typedef struct
+{
+    metric_group_t group;
+    const char* name;
+    const char* help;
+    bool cumulative;
+} metric_def_t;
+
+/** Description of every metric, indexed by metric_id */
+static const metric_def_t metric_defs[METRIC_COUNT] = {
+    [CPU_USAGE] = {METRIC_GROUP_CPU, "cpu_usage_percentage", "CPU usage percentage", false},
+    [MEMORY_USAGE] = {METRIC_GROUP_MEMORY, "memory_usage_percentage", "Memory usage percentage", false},
+    [DISK_IO_READS] = {METRIC_GROUP_DISK_IO, "disk_io_reads", "Number of disk read sectors", true},
+    [DISK_IO_WRITES] = {METRIC_GROUP_DISK_IO, "disk_io_writes", "Number of disk write sectors", true},
+    [RX_BYTES] = {METRIC_GROUP_NETWORK, "network_rx_bytes", "Bytes received over the network", true},
+    [TX_BYTES] = {METRIC_GROUP_NETWORK, "network_tx_bytes", "Bytes transmitted over the network", true},
+    [RX_ERRORS] = {METRIC_GROUP_NETWORK, "network_rx_errors", "Network receive errors", true},
+    [TX_ERRORS] = {METRIC_GROUP_NETWORK, "network_tx_errors", "Network transmit errors", true},
+    [COLLISIONS] = {METRIC_GROUP_NETWORK, "network_collisions", "Network collisions", true},
+    [PROCESS_COUNT] = {METRIC_GROUP_PROCESS_COUNT, "process_count", "Number of running processes", false},
+    [CONTEXT_SWITCHES] = {METRIC_GROUP_CONTEXT_SWITCHES, "context_switches", "Number of context switches", true},
+};
+
+/** Registry family of each metric, indexed by metric_id */
+static int metric_families[METRIC_COUNT];
+
+/** Description of the per-CPU perf software event counters, indexed by perf_event_id_t */
+static const metric_def_t perf_defs[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CONTEXT_SWITCHES] = {METRIC_GROUP_PERF_EVENTS, "perf_context_switches",
+                                     "Context switches on each CPU counted by perf", true},
+    [PERF_EVENT_CPU_MIGRATIONS] = {METRIC_GROUP_PERF_EVENTS, "perf_cpu_migrations",
+                                   "Task migrations to each CPU counted by perf", true},
+    [PERF_EVENT_PAGE_FAULTS] = {METRIC_GROUP_PERF_EVENTS, "perf_page_faults", "Page faults on each CPU counted by perf",
+                                true},
+    [PERF_EVENT_MAJOR_FAULTS] = {METRIC_GROUP_PERF_EVENTS, "perf_major_page_faults",
+                                 "Major page faults on each CPU counted by perf", true},
+};
+
+/** Registry family of each perf event, with one series per CPU */
+static int perf_families[PERF_EVENT_COUNT];
+
+/** Last perf counters read, indexed by CPU and event */
+static uint64_t perf_counts[PLATFORM_MAX_CPUS][PERF_EVENT_COUNT];
+
+/** Description of the per-CPU process lifecycle counters, indexed by proc_event_kind_t */
+static const metric_def_t proc_defs[PROC_EVENT_KIND_COUNT] = {
+    [PROC_EVENT_KIND_FORK] = {METRIC_GROUP_PROC_EVENTS, "process_forks", "Processes created on each CPU", true},
+    [PROC_EVENT_KIND_EXEC] = {METRIC_GROUP_PROC_EVENTS, "process_execs", "Program executions on each CPU", true},
+    [PROC_EVENT_KIND_EXIT] = {METRIC_GROUP_PROC_EVENTS, "process_exits", "Processes exited on each CPU", true},
+    [PROC_EVENT_KIND_FAILED] = {METRIC_GROUP_PROC_EVENTS, "process_failed_exits",
+                                "Processes exited with a non-zero status on each CPU", true},
+    [PROC_EVENT_KIND_SIGNALED] = {METRIC_GROUP_PROC_EVENTS, "process_signaled_exits",
+                                  "Processes terminated by a signal on each CPU", true},
+};
+
+/** Description of the counter of process event socket overruns reported by the kernel */
+static const metric_def_t proc_lost_def = {METRIC_GROUP_PROC_EVENTS, "process_events_lost",
+                                           "Times the process event socket overflowed (ENOBUFS); each overflow "
+                                           "may have dropped several events",
+                                           true};
+
+/** Registry family of each process event, with one series per CPU */
+static int proc_families[PROC_EVENT_KIND_COUNT];
+
+/** Registry family of the process event socket overruns */
+static int proc_lost_family;
+
+/** Last process event counters read, indexed by CPU and event */
+static uint64_t proc_counts[PLATFORM_MAX_CPUS][PROC_EVENT_KIND_COUNT];
+
+/** Scheduler rates exported for each CPU and for the top tasks */
+enum sched_rate
+{
+    SCHED_RUN_DELAY,
+    SCHED_TIMESLICES,
+    SCHED_RATE_COUNT
+};
+
+/** Description of the per-CPU scheduler rates, indexed by sched_rate */
+static const metric_def_t sched_cpu_defs[SCHED_RATE_COUNT] = {
+    [SCHED_RUN_DELAY] = {METRIC_GROUP_SCHEDSTAT, "sched_run_delay_seconds_per_second",
+                         "Time tasks spent waiting on the runqueue of each CPU, per second", false},
+    [SCHED_TIMESLICES] = {METRIC_GROUP_SCHEDSTAT, "sched_timeslices_per_second",
+                          "Timeslices run on each CPU per second", false},
+};
+
+/** Description of the scheduler rates of the tasks that waited the most, indexed by sched_rate */
+static const metric_def_t sched_task_defs[SCHED_RATE_COUNT] = {
+    [SCHED_RUN_DELAY] = {METRIC_GROUP_SCHEDSTAT, "process_sched_run_delay_seconds_per_second",
+                         "Time the processes that waited the most spent on a runqueue, per second", false},
+    [SCHED_TIMESLICES] = {METRIC_GROUP_SCHEDSTAT, "process_sched_timeslices_per_second",
+                          "Timeslices run per second by the processes that waited the most", false},
+};
+
+/** Registry family of each per-CPU scheduler rate, with one series per CPU */
+static int sched_cpu_families[SCHED_RATE_COUNT];
+
+/** Registry family of each top task scheduler rate, with one series per rank */
+static int sched_task_families[SCHED_RATE_COUNT];
+
+/** Registry family mapping each rank to the process that holds it, with value 1 */
+static int sched_task_info_family;
 
-/** Métrica from Prometheus for the memory usage */
-static prom_gauge_t* memory_usage_metric;
+/** Whether the kernel exposes /proc/schedstat, checked on every reconcile */
+static bool schedstat_present;
 
-/** Métric de Prometheus for the number of read sectors */
-static prom_gauge_t* disk_io_reads_metric;
+/** Last per-CPU scheduler rates read */
+static schedstat_rates_t sched_rates[PLATFORM_MAX_CPUS];
+
+/** Last top tasks read */
+static schedstat_task_t sched_top[CONFIG_MAX_SCHEDSTAT_TOP_TASKS];
+
+/** Registry family with the effective sampling rate of each group */
+static int sample_rate_family;
+
+/** Registry family with the time it took the agent to be ready for its first scrape */
+static int startup_family;
+
+/** HTTP server, running once the first valid sample has been collected */
+static struct MHD_Daemon* http_daemon;
+
+/** Last sample of a metric, used to measure how fast its group is changing */
+typedef struct
+{
+    double value;  // Last value sampled
+    double level;  // Last level: the value itself, or the per-second rate of a cumulative metric
+    int64_t at_ns; // When the last value was sampled (CLOCK_MONOTONIC)
+    bool has_value;
+    bool has_level;
+} change_state_t;
+
+/** Change tracking state of each metric */
+static change_state_t change_states[METRIC_COUNT];
+
+/** Change tracking state of each perf event, summed over all CPUs */
+static change_state_t perf_change_states[PERF_EVENT_COUNT];
+
+/** Change tracking state of each process event, summed over all CPUs */
+static change_state_t proc_change_states[PROC_EVENT_KIND_COUNT];
+
+/** Change tracking state of each per-CPU scheduler rate, summed over all CPUs */
+static change_state_t sched_change_states[SCHED_RATE_COUNT];
+
+/** Largest relative change of each group since the last take_group_change() */
+static double group_changes[METRIC_GROUP_COUNT];
+
+/** Maximum number of open HTTP connections; each one has at most one response in flight */
+#define HTTP_CONNECTIONS 16
+
+/** Number of output buffers: one per connection, so an accepted scrape always finds one
+ * even while slow clients are still receiving theirs */
+#define SCRAPE_BUFFERS HTTP_CONNECTIONS
+
+/** Number of threads serving HTTP requests, so concurrent scrapes can share a collection */
+#define HTTP_THREADS 4
+
+/** Preallocated output buffer for the exposition of one scrape */
+typedef struct
+{
+    char* data;
+    bool in_use;
+} scrape_buffer_t;
+
+/** Output buffers, allocated once the registry is complete */
+static scrape_buffer_t scrape_buffers[SCRAPE_BUFFERS];
+
+/** Size of each output buffer */
+static size_t scrape_buffer_size;
+
+/**
+ * @brief Records how much a metric's level changed since its previous sample
+ *
+ * Cumulative metrics are turned into per-second rates first, so a steady
+ * counter counts as flat. The relative change is measured against the
+ * previous level, with a floor of 1 so values near zero do not explode.
+ */
+static void track_change(const metric_def_t* def, change_state_t* state, double value)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
 
-/** Métric from Prometheus for the number of written sectors */
-static prom_gauge_t* disk_io_writes_metric;
+    double level = value;
+    bool has_level = true;
+    if (def->cumulative)
+    {
+        has_level = state->has_value && now_ns > state->at_ns;
+        level = has_level ? (value - state->value) * 1e9 / (now_ns - state->at_ns) : 0;
+    }
 
-/** Métric de Prometheus for the received bytes */
-static prom_gauge_t* rx_bytes_metric;
+    if (has_level && state->has_level)
+    {
+        double change = fabs(level - state->level) / fmax(fabs(state->level), 1.0);
+        group_changes[def->group] = fmax(group_changes[def->group], change);
+    }
 
-/** Métric from Prometheus for the transmitted */
-static prom_gauge_t* tx_bytes_metric;
+    state->value = value;
+    state->at_ns = now_ns;
+    state->has_value = true;
+    if (has_level)
+    {
+        state->level = level;
+        state->has_level = true;
+    }
+}
 
-/** Métric from Prometheus for the reception errors */
-static prom_gauge_t* rx_errors_metric;
+/**
+ * @brief Publishes a sampled value to the registry
+ *
+ * Must be called with the mutex held.
+ */
+static void set_metric(enum metric_id id, double value)
+{
+    track_change(&metric_defs[id], &change_states[id], value);
+    registry_set(metric_families[id], 0, value);
+}
 
-/** Métric from Prometheus for the transmission errors */
-static prom_gauge_t* tx_errors_metric;
+/**
+ * @brief Returns the largest relative change of a group and resets it
+ */
+double take_group_change(metric_group_t group)
+{
+    pthread_mutex_lock(&lock);
+    double change = group_changes[group];
+    group_changes[group] = 0;
+    pthread_mutex_unlock(&lock);
 
-/** Métric from Prometheus for the collisions */
-static prom_gauge_t* collisions_metric;
+    return change;
+}
 
-/** Métric from Prometheus for the number of running processes */
-static prom_gauge_t* process_count_metric;
+/**
+ * @brief Updates the effective sampling rate metric of a group
+ */
+void update_sample_rate_gauge(metric_group_t group, double hertz)
+{
+    pthread_mutex_lock(&lock);
+    registry_set(sample_rate_family, group, hertz);
+    pthread_mutex_unlock(&lock);
+}
 
-/** Métric from Prometheus for the number of context switches */
-static prom_gauge_t* context_switches_metric;
+/**
+ * @brief Updates the time-to-first-valid-scrape metric
+ */
+void update_startup_gauge(double seconds)
+{
+    pthread_mutex_lock(&lock);
+    registry_set(startup_family, 0, seconds);
+    pthread_mutex_unlock(&lock);
+}
 
 /**
  * @brief Updates the context switch metric
@@ -52,9 +299,9 @@ void update_context_switches_gauge()
 
     if (ctxt != (unsigned long long)-1) // Ensures no error occurred during retrieval
     {
-        pthread_mutex_lock(&lock);                           // Locks the mutex for thread-safe access
-        prom_gauge_set(context_switches_metric, ctxt, NULL); // Updates the context switch metric with the new count
-        pthread_mutex_unlock(&lock);                         // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);          // Locks the mutex for thread-safe access
+        set_metric(CONTEXT_SWITCHES, ctxt); // Updates the context switch metric with the new count
+        pthread_mutex_unlock(&lock);        // Unlocks the mutex after updating
     }
     else
     {
@@ -62,6 +309,9 @@ void update_context_switches_gauge()
     }
 }
 
+/** Whether a CPU usage sample has been published; collection cycles never overlap (see collector.c) */
+static bool cpu_usage_published;
+
 /**
  * @brief Updates the CPU usage metric
  * 
@@ -70,13 +320,23 @@ void update_context_switches_gauge()
  */
 void update_cpu_gauge()
 {
+    // Until the first sample spans enough jiffies to mean something, keep the reference
+    // reading and leave the metric absent instead of publishing a 0/50/100% sample
+    long long jiffies = cpu_usage_published ? -1 : cpu_usage_elapsed_jiffies();
+    if (jiffies >= 0 && jiffies < CPU_USAGE_MIN_JIFFIES)
+    {
+        return;
+    }
+
     double usage = get_cpu_usage(); // Retrieves the current CPU usage
 
     if (usage >= 0) // Checks if the retrieved CPU usage is valid
     {
-        pthread_mutex_lock(&lock);                     // Locks the mutex for thread-safe access
-        prom_gauge_set(cpu_usage_metric, usage, NULL); // Updates the CPU usage metric with the retrieved value
-        pthread_mutex_unlock(&lock);                   // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);    // Locks the mutex for thread-safe access
+        set_metric(CPU_USAGE, usage); // Updates the CPU usage metric with the retrieved value
+        registry_set_active_series(metric_families[CPU_USAGE], 1);
+        pthread_mutex_unlock(&lock);  // Unlocks the mutex after updating
+        cpu_usage_published = true;
     }
     else
     {
@@ -96,9 +356,9 @@ void update_memory_gauge()
 
     if (usage >= 0) // Checks if the retrieved memory usage is valid
     {
-        pthread_mutex_lock(&lock);                        // Locks the mutex for thread-safe access
-        prom_gauge_set(memory_usage_metric, usage, NULL); // Updates the memory usage metric with the retrieved value
-        pthread_mutex_unlock(&lock);                      // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);       // Locks the mutex for thread-safe access
+        set_metric(MEMORY_USAGE, usage); // Updates the memory usage metric with the retrieved value
+        pthread_mutex_unlock(&lock);     // Unlocks the mutex after updating
     }
     else
     {
@@ -115,14 +375,13 @@ void update_memory_gauge()
 void update_disk_io_gauge()
 {
     unsigned long long reads = 0, writes = 0;
-    get_disk_io(&reads, &writes); // Retrieves disk I/O statistics for reads and writes
-
-    if (reads >= 0 && writes >= 0) // Checks if the read and write values are valid
+    // Retrieves disk I/O statistics; on error the zeroed totals must not be published as a counter reset
+    if (get_disk_io(&reads, &writes) == 0)
     {
-        pthread_mutex_lock(&lock);                           // Locks the mutex for thread-safe access
-        prom_gauge_set(disk_io_reads_metric, reads, NULL);   // Updates the metric for disk read operations
-        prom_gauge_set(disk_io_writes_metric, writes, NULL); // Updates the metric for disk write operations
-        pthread_mutex_unlock(&lock);                         // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);          // Locks the mutex for thread-safe access
+        set_metric(DISK_IO_READS, reads);   // Updates the metric for disk read operations
+        set_metric(DISK_IO_WRITES, writes); // Updates the metric for disk write operations
+        pthread_mutex_unlock(&lock);        // Unlocks the mutex after updating
     }
     else
     {
@@ -143,17 +402,15 @@ void update_network_gauge()
     unsigned long long rx_errors = 0, tx_errors = 0;
     unsigned long long collisions = 0;
 
-    get_network_stats(&rx_bytes, &tx_bytes, &rx_errors, &tx_errors, &collisions);
-
-    if (rx_bytes >= 0 && tx_bytes >= 0 && rx_errors >= 0 && tx_errors >= 0 && collisions >= 0)
+    if (get_network_stats(&rx_bytes, &tx_bytes, &rx_errors, &tx_errors, &collisions) == 0)
     {
-        pthread_mutex_lock(&lock);                           // Locks the mutex for thread-safe access
-        prom_gauge_set(rx_bytes_metric, rx_bytes, NULL);     // Updates the metric for received bytes
-        prom_gauge_set(tx_bytes_metric, tx_bytes, NULL);     // Updates the metric for transmitted bytes
-        prom_gauge_set(rx_errors_metric, rx_errors, NULL);   // Updates the metric for receive errors
-        prom_gauge_set(tx_errors_metric, tx_errors, NULL);   // Updates the metric for transmit errors
-        prom_gauge_set(collisions_metric, collisions, NULL); // Updates the metric for network collisions
-        pthread_mutex_unlock(&lock);                         // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);          // Locks the mutex for thread-safe access
+        set_metric(RX_BYTES, rx_bytes);     // Updates the metric for received bytes
+        set_metric(TX_BYTES, tx_bytes);     // Updates the metric for transmitted bytes
+        set_metric(RX_ERRORS, rx_errors);   // Updates the metric for receive errors
+        set_metric(TX_ERRORS, tx_errors);   // Updates the metric for transmit errors
+        set_metric(COLLISIONS, collisions); // Updates the metric for network collisions
+        pthread_mutex_unlock(&lock);        // Unlocks the mutex after updating
     }
     else
     {
@@ -173,9 +430,9 @@ void update_process_count_gauge()
 
     if (process_count >= 0)
     {
-        pthread_mutex_lock(&lock);                                 // Locks the mutex for thread-safe access
-        prom_gauge_set(process_count_metric, process_count, NULL); // Updates the process count metric
-        pthread_mutex_unlock(&lock);                               // Unlocks the mutex after updating
+        pthread_mutex_lock(&lock);                // Locks the mutex for thread-safe access
+        set_metric(PROCESS_COUNT, process_count); // Updates the process count metric
+        pthread_mutex_unlock(&lock);              // Unlocks the mutex after updating
     }
     else
     {
@@ -184,58 +441,600 @@ void update_process_count_gauge()
 }
 
 /**
- * @brief Updates the context switches metric
- * 
- * This function retrieves the current context switch count and updates
- * the corresponding metric in the Prometheus registry.
+ * @brief Updates the per-CPU perf software event counters
+ *
+ * One grouped read() per CPU, outside the mutex; nothing is done while the
+ * perf events are not open. Collection cycles never overlap a reconcile
+ * (see reconcile_collection()), so the descriptors stay open meanwhile.
  */
-void update_context_switches_gauge()
+void update_perf_events_gauge()
 {
-    unsigned long long ctxt = get_ctxt();
-    if (ctxt != (unsigned long long)-1)
+    if (perf_events_read(perf_counts) != 0)
     {
-        pthread_mutex_lock(&lock);
-        prom_gauge_set(context_switches_metric, ctxt, NULL);
-        pthread_mutex_unlock(&lock);
+        return;
     }
-    else
+
+    int cpus = platform_cpu_count();
+    pthread_mutex_lock(&lock);
+    for (int event = 0; event < PERF_EVENT_COUNT; event++)
     {
-        fprintf(stderr, "Error retrieving context switch count\n");
+        double total = 0;
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            registry_set(perf_families[event], cpu, (double)perf_counts[cpu][event]);
+            total += (double)perf_counts[cpu][event];
+        }
+        track_change(&perf_defs[event], &perf_change_states[event], total);
     }
+    pthread_mutex_unlock(&lock);
 }
 
 /**
- * @brief Function to expose metrics through an HTTP server
- * 
- * This function starts an HTTP server that exposes the system's metrics
- * to be scraped by Prometheus or other monitoring tools.
+ * @brief Queues a static plain text response
+ */
+static enum MHD_Result send_text(struct MHD_Connection* connection, unsigned int status, const char* text)
+{
+    struct MHD_Response* response =
+        MHD_create_response_from_buffer(strlen(text), (void*)text, MHD_RESPMEM_PERSISTENT);
+    if (response == NULL)
+    {
+        return MHD_NO;
+    }
+
+    enum MHD_Result ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+/** Content-Type of each exposition format */
+static const char* const content_types[] = {
+    [REGISTRY_FORMAT_TEXT] = "text/plain; version=0.0.4",
+    [REGISTRY_FORMAT_OPENMETRICS] = "application/openmetrics-text; version=1.0.0; charset=utf-8",
+    [REGISTRY_FORMAT_PROTOBUF] = "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; "
+                                 "encoding=delimited",
+};
+
+/** Longest media range of an Accept header that is inspected */
+#define MEDIA_RANGE_SIZE 256
+
+/**
+ * @brief Parses one media range of an Accept header in place
+ *
+ * @return false if the range names a format that is not served
  */
-void* expose_metrics(void* arg)
+static bool parse_media_range(char* range, registry_format_t* format, double* quality)
 {
-    (void)arg; // Unused argument
-    promhttp_set_active_collector_registry(NULL);
+    char* state = NULL;
+    char* type = strtok_r(range, "; \t", &state);
+    bool delimited = false, metric_family = false;
 
-    struct MHD_Daemon* daemon = promhttp_start_daemon(MHD_USE_SELECT_INTERNALLY, 8000, NULL, NULL);
-    if (daemon == NULL)
+    *quality = 1.0;
+    for (char* param = strtok_r(NULL, "; \t", &state); param != NULL; param = strtok_r(NULL, "; \t", &state))
     {
-        fprintf(stderr, "Error starting HTTP server\n");
-        return NULL;
+        if (strncasecmp(param, "q=", 2) == 0)
+        {
+            *quality = strtod(param + 2, NULL);
+        }
+        delimited |= strcasecmp(param, "encoding=delimited") == 0;
+        metric_family |= strcmp(param, "proto=io.prometheus.client.MetricFamily") == 0;
+    }
+
+    if (type == NULL)
+    {
+        return false;
+    }
+    if (strcasecmp(type, "application/vnd.google.protobuf") == 0)
+    {
+        *format = REGISTRY_FORMAT_PROTOBUF;
+        return delimited && metric_family;
+    }
+    if (strcasecmp(type, "application/openmetrics-text") == 0)
+    {
+        *format = REGISTRY_FORMAT_OPENMETRICS;
+        return true;
+    }
+    *format = REGISTRY_FORMAT_TEXT;
+    return strcasecmp(type, "text/plain") == 0 || strcmp(type, "text/*") == 0 || strcmp(type, "*/*") == 0;
+}
+
+/**
+ * @brief Picks the exposition format from the Accept header
+ *
+ * The served format with the highest quality wins; ties go to the one
+ * listed first. Without a usable Accept header the classic text format is
+ * served.
+ */
+static registry_format_t negotiate_format(const char* accept)
+{
+    registry_format_t best = REGISTRY_FORMAT_TEXT;
+    double best_quality = 0;
+
+    while (accept != NULL && *accept != '\0')
+    {
+        const char* end = strchr(accept, ',');
+        size_t length = end != NULL ? (size_t)(end - accept) : strlen(accept);
+
+        char range[MEDIA_RANGE_SIZE];
+        snprintf(range, sizeof(range), "%.*s", (int)length, accept);
+
+        registry_format_t format;
+        double quality;
+        if (parse_media_range(range, &format, &quality) && quality > best_quality)
+        {
+            best = format;
+            best_quality = quality;
+        }
+
+        accept = end != NULL ? end + 1 : NULL;
+    }
+
+    return best;
+}
+
+/**
+ * @brief Updates the per-CPU process lifecycle counters
+ *
+ * The counters are maintained by the netlink receiver thread and read
+ * without blocking it; nothing is done while the connector is closed.
+ */
+void update_proc_events_gauge()
+{
+    uint64_t lost = 0;
+    if (proc_events_read(proc_counts, &lost) != 0)
+    {
+        return;
+    }
+
+    int cpus = platform_cpu_count();
+    pthread_mutex_lock(&lock);
+    for (int kind = 0; kind < PROC_EVENT_KIND_COUNT; kind++)
+    {
+        double total = 0;
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            registry_set(proc_families[kind], cpu, (double)proc_counts[cpu][kind]);
+            total += (double)proc_counts[cpu][kind];
+        }
+        track_change(&proc_defs[kind], &proc_change_states[kind], total);
+    }
+    registry_set(proc_lost_family, 0, (double)lost);
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief Formats the labels of a top task info series
+ *
+ * The rate series are identified by rank alone, so their count stays
+ * bounded; pid and comm only appear here and are joined on rank. The
+ * process name is chosen by the process itself, so anything that would
+ * break the label syntax is replaced.
+ */
+static void format_task_labels(char* labels, size_t size, int rank, const schedstat_task_t* task)
+{
+    char comm[SCHEDSTAT_COMM_SIZE];
+    size_t i = 0;
+    for (; task->comm[i] != '\0' && i < sizeof(comm) - 1; i++)
+    {
+        char c = task->comm[i];
+        comm[i] = c == '"' || c == '\\' || c < ' ' || c == 0x7f ? '_' : c;
+    }
+    comm[i] = '\0';
+
+    snprintf(labels, size, "rank=\"%d\",pid=\"%d\",comm=\"%s\"", rank, (int)task->pid, comm);
+}
+
+/**
+ * @brief Updates the per-CPU runqueue latency and timeslice rates
+ *
+ * /proc/schedstat is parsed outside the mutex. When top tasks are
+ * configured, /proc is also walked to rank processes by how long they
+ * waited since the previous collection.
+ */
+void update_schedstat_gauge()
+{
+    if (!schedstat_present || schedstat_read_cpus(sched_rates) != 0)
+    {
+        return;
+    }
+
+    const monitor_config_t* config = config_acquire();
+    int top_tasks = config->schedstat_top_tasks;
+    config_release(config);
+
+    int tasks = top_tasks > 0 ? schedstat_top_tasks(sched_top, top_tasks) : 0;
+
+    int cpus = platform_cpu_count();
+    pthread_mutex_lock(&lock);
+    double run_delay = 0, timeslices = 0;
+    for (int cpu = 0; cpu < cpus; cpu++)
+    {
+        registry_set(sched_cpu_families[SCHED_RUN_DELAY], cpu, sched_rates[cpu].run_delay);
+        registry_set(sched_cpu_families[SCHED_TIMESLICES], cpu, sched_rates[cpu].timeslices);
+        run_delay += sched_rates[cpu].run_delay;
+        timeslices += sched_rates[cpu].timeslices;
+    }
+    track_change(&sched_cpu_defs[SCHED_RUN_DELAY], &sched_change_states[SCHED_RUN_DELAY], run_delay);
+    track_change(&sched_cpu_defs[SCHED_TIMESLICES], &sched_change_states[SCHED_TIMESLICES], timeslices);
+
+    for (int rank = 0; rank < tasks; rank++)
+    {
+        char labels[SERIES_LABELS_SIZE];
+        format_task_labels(labels, sizeof(labels), rank + 1, &sched_top[rank]);
+        registry_set_labels(sched_task_info_family, rank, labels);
+        registry_set(sched_task_families[SCHED_RUN_DELAY], rank, sched_top[rank].rates.run_delay);
+        registry_set(sched_task_families[SCHED_TIMESLICES], rank, sched_top[rank].rates.timeslices);
+    }
+    for (int rate = 0; rate < SCHED_RATE_COUNT; rate++)
+    {
+        registry_set_active_series(sched_task_families[rate], tasks > 0 ? (size_t)tasks : 0);
     }
+    registry_set_active_series(sched_task_info_family, tasks > 0 ? (size_t)tasks : 0);
+    pthread_mutex_unlock(&lock);
+}
+
+void prime_schedstat_gauge()
+{
+    const monitor_config_t* config = config_acquire();
+    bool enabled = config->enabled[METRIC_GROUP_SCHEDSTAT] && schedstat_present;
+    int top_tasks = config->schedstat_top_tasks;
+    config_release(config);
 
-    while (1)
+    if (enabled)
     {
-        sleep(1); // Keep the server running
+        schedstat_read_cpus(sched_rates);
+        if (top_tasks > 0)
+        {
+            schedstat_top_tasks(sched_top, top_tasks);
+        }
     }
+}
 
-    MHD_stop_daemon(daemon); // Stop the server when done
+/**
+ * @brief Reserves a free output buffer until release_scrape()
+ *
+ * Must be called with the mutex held.
+ */
+static char* acquire_scrape_buffer()
+{
+    for (int i = 0; i < SCRAPE_BUFFERS; i++)
+    {
+        if (scrape_buffers[i].data != NULL && !scrape_buffers[i].in_use)
+        {
+            scrape_buffers[i].in_use = true;
+            return scrape_buffers[i].data;
+        }
+    }
     return NULL;
 }
 
 /**
- * @brief Initializes the Prometheus metrics
+ * @brief Renders the registry into a free output buffer
+ *
+ * No memory is allocated: the exposition is written straight into one of
+ * the preallocated buffers, which stays reserved until release_scrape().
+ */
+char* render_scrape(registry_format_t format, size_t* length)
+{
+    pthread_mutex_lock(&lock);
+    char* out = acquire_scrape_buffer();
+    if (out != NULL)
+    {
+        publish_stream_stats(); // Summaries are computed at scrape time
+        *length = registry_render(out, scrape_buffer_size, format);
+    }
+    pthread_mutex_unlock(&lock);
+
+    return out;
+}
+
+/**
+ * @brief Returns an output buffer obtained from render_scrape()
+ */
+void release_scrape(void* buffer)
+{
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < SCRAPE_BUFFERS; i++)
+    {
+        if (scrape_buffers[i].data == buffer)
+        {
+            scrape_buffers[i].in_use = false;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief Queues the merged exposition of the aggregated agents
+ *
+ * The exposition stays referenced until libmicrohttpd has sent it, even if
+ * a newer one is published meanwhile.
+ */
+static enum MHD_Result send_aggregate(struct MHD_Connection* connection)
+{
+    size_t length = 0;
+    char* body = aggregate_acquire(&length);
+    if (body == NULL)
+    {
+        return send_text(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "Metrics not ready\n");
+    }
+
+    struct MHD_Response* response = MHD_create_response_from_buffer_with_free_callback(length, body, aggregate_release);
+    if (response == NULL)
+    {
+        aggregate_release(body);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, content_types[REGISTRY_FORMAT_TEXT]);
+
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+/**
+ * @brief Queues the recent process events kept in the ring
+ *
+ * Only served while the proc_events group is active and the ring is
+ * enabled. The events are rendered into a free output buffer, like a scrape,
+ * so no memory is allocated per request.
+ */
+static enum MHD_Result send_proc_events(struct MHD_Connection* connection)
+{
+    char* body = NULL;
+    size_t length = 0;
+
+    // reconcile_metrics() opens the connector and resizes the ring under the same lock, so
+    // the ring cannot grow past the buffer between the check and the render
+    pthread_mutex_lock(&lock);
+    bool available = proc_events_available() && proc_events_ring_capacity() > 0;
+    if (available && (body = acquire_scrape_buffer()) != NULL)
+    {
+        length = proc_events_render_ring(body, scrape_buffer_size);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (!available)
+    {
+        return send_text(connection, MHD_HTTP_NOT_FOUND, "Not Found\n");
+    }
+    if (body == NULL)
+    {
+        return send_text(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "All output buffers are in use\n");
+    }
+
+    struct MHD_Response* response = MHD_create_response_from_buffer_with_free_callback(length, body, release_scrape);
+    if (response == NULL)
+    {
+        release_scrape(body);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=utf-8");
+
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+/**
+ * @brief HTTP handler serving the registry on /metrics
+ *
+ * In collect-on-scrape mode the values are refreshed first; concurrent
+ * scrapes are coalesced into one collection. In aggregator mode the merged
+ * exposition of the upstream agents is served instead of the registry. The response points into the
+ * output buffer, which is given back to the pool by libmicrohttpd once the
+ * body has been sent.
+ */
+static enum MHD_Result handle_request(void* cls, struct MHD_Connection* connection, const char* url,
+                                      const char* method, const char* version, const char* upload_data,
+                                      size_t* upload_data_size, void** con_cls)
+{
+    (void)cls;
+    (void)version;
+    (void)upload_data;
+    (void)upload_data_size;
+    (void)con_cls;
+
+    if (strcmp(method, "GET") != 0)
+    {
+        return send_text(connection, MHD_HTTP_METHOD_NOT_ALLOWED, "Method Not Allowed\n");
+    }
+    if (strcmp(url, "/proc_events") == 0)
+    {
+        return send_proc_events(connection);
+    }
+    if (strcmp(url, "/metrics") != 0)
+    {
+        return send_text(connection, MHD_HTTP_NOT_FOUND, "Not Found\n");
+    }
+
+    const monitor_config_t* config = config_acquire();
+    bool aggregating = config != NULL && config->upstream_count > 0;
+    if (aggregating)
+    {
+        aggregate_refresh(config, config->scrape_min_age_ms);
+    }
+    else if (config != NULL && config->collect_on_scrape)
+    {
+        collect_metrics(config->scrape_min_age_ms);
+    }
+    config_release(config);
+
+    if (aggregating)
+    {
+        return send_aggregate(connection);
+    }
+
+    registry_format_t format =
+        negotiate_format(MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT));
+    size_t length = 0;
+    char* body = render_scrape(format, &length);
+    if (body == NULL)
+    {
+        return send_text(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "Metrics not ready\n");
+    }
+
+    struct MHD_Response* response = MHD_create_response_from_buffer_with_free_callback(length, body, release_scrape);
+    if (response == NULL)
+    {
+        release_scrape(body);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, content_types[format]);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT);
+
+    enum MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+/**
+ * @brief Starts the HTTP server that exposes the metrics
+ *
+ * The listen socket is only opened here, so it must be called once the
+ * registry holds valid data: a scraper can never see an uninitialised or
+ * unprimed registry. libmicrohttpd serves requests from its own thread
+ * pool, so this returns right away.
+ */
+int start_http_server()
+{
+    http_daemon = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY, HTTP_PORT, NULL, NULL, &handle_request, NULL,
+                                   MHD_OPTION_THREAD_POOL_SIZE, (unsigned int)HTTP_THREADS,
+                                   MHD_OPTION_CONNECTION_LIMIT, (unsigned int)HTTP_CONNECTIONS, MHD_OPTION_END);
+    if (http_daemon == NULL)
+    {
+        fprintf(stderr, "Error starting HTTP server\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Stops the HTTP server started by start_http_server()
+ */
+void stop_http_server()
+{
+    if (http_daemon != NULL)
+    {
+        MHD_stop_daemon(http_daemon);
+        http_daemon = NULL;
+    }
+}
+
+/**
+ * @brief Checks whether the kernel interface behind a group is open or present
+ *
+ * Must be called with the lock held; groups read from /proc are always available.
+ */
+static bool backend_available(metric_group_t group)
+{
+    switch (group)
+    {
+    case METRIC_GROUP_PERF_EVENTS:
+        return perf_events_available();
+    case METRIC_GROUP_PROC_EVENTS:
+        return proc_events_available();
+    case METRIC_GROUP_SCHEDSTAT:
+        return schedstat_present;
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Checks whether a group can be collected
+ */
+bool group_available(metric_group_t group)
+{
+    pthread_mutex_lock(&lock);
+    bool available = backend_available(group);
+    pthread_mutex_unlock(&lock);
+
+    return available;
+}
+
+/**
+ * @brief Reconciles the exported metrics with a configuration
+ *
+ * Groups are switched on and off in the registry; their series and the
+ * sampled values are kept, so the HTTP server keeps running and unchanged
+ * collectors keep their rate state.
+ */
+int reconcile_metrics(const monitor_config_t* config)
+{
+    pthread_mutex_lock(&lock);
+
+    // perf events are only open while their group is enabled; if the kernel
+    // forbids them the group stays hidden and /proc/stat is still used
+    if (!config->enabled[METRIC_GROUP_PERF_EVENTS])
+    {
+        perf_events_close();
+    }
+    else if (!perf_events_available() && perf_events_open() == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        for (int event = 0; event < PERF_EVENT_COUNT; event++)
+        {
+            for (int cpu = 0; cpu < platform_cpu_count(); cpu++)
+            {
+                registry_set(perf_families[event], cpu, 0);
+                registry_set_created(perf_families[event], cpu, now.tv_sec + now.tv_nsec / 1e9);
+            }
+            perf_change_states[event].has_value = false;
+            perf_change_states[event].has_level = false;
+        }
+    }
+
+    // Same for the netlink proc connector, which needs CAP_NET_ADMIN
+    if (!config->enabled[METRIC_GROUP_PROC_EVENTS])
+    {
+        proc_events_close();
+    }
+    else if (!proc_events_available() && proc_events_open() == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        for (int kind = 0; kind < PROC_EVENT_KIND_COUNT; kind++)
+        {
+            for (int cpu = 0; cpu < platform_cpu_count(); cpu++)
+            {
+                registry_set(proc_families[kind], cpu, 0);
+                registry_set_created(proc_families[kind], cpu, now.tv_sec + now.tv_nsec / 1e9);
+            }
+            proc_change_states[kind].has_value = false;
+            proc_change_states[kind].has_level = false;
+        }
+        registry_set(proc_lost_family, 0, 0);
+        registry_set_created(proc_lost_family, 0, now.tv_sec + now.tv_nsec / 1e9);
+    }
+    proc_events_set_ring(config->proc_events_ring);
+
+    // Without CONFIG_SCHEDSTATS the group stays hidden and is not collected
+    schedstat_present = schedstat_available();
+    if (config->schedstat_top_tasks == 0)
+    {
+        for (int rate = 0; rate < SCHED_RATE_COUNT; rate++)
+        {
+            registry_set_active_series(sched_task_families[rate], 0);
+        }
+        registry_set_active_series(sched_task_info_family, 0);
+    }
+
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        registry_enable_group(group, config->enabled[group] && backend_available(group));
+    }
+    pthread_mutex_unlock(&lock);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Initializes the metrics
  * 
- * This function initializes all the Prometheus metrics and registers them
- * to the default collector registry.
+ * This function initializes the mutex, registers every metric in the
+ * registry and preallocates the output buffers for the scrapes.
  */
 int init_metrics()
 {
@@ -245,39 +1044,160 @@ int init_metrics()
         return EXIT_FAILURE;
     }
 
-    if (prom_collector_registry_default_init() != 0)
+    // Register metrics
+    for (int id = 0; id < METRIC_COUNT; id++)
+    {
+        const metric_def_t* def = &metric_defs[id];
+        // Gauges, as they have always been exposed: as counters they would be renamed to <name>_total
+        metric_families[id] = registry_add_family(def->name, def->help, METRIC_TYPE_GAUGE, def->group, 1);
+        if (metric_families[id] < 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    registry_set_active_series(metric_families[CPU_USAGE], 0); // Absent until a sample spans CPU_USAGE_MIN_JIFFIES
+
+    int cpus = platform_cpu_count();
+    for (int event = 0; event < PERF_EVENT_COUNT; event++)
+    {
+        const metric_def_t* def = &perf_defs[event];
+        perf_families[event] = registry_add_family(def->name, def->help, METRIC_TYPE_COUNTER, def->group, cpus);
+        if (perf_families[event] < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            char labels[SERIES_LABELS_SIZE];
+            snprintf(labels, sizeof(labels), "cpu=\"%d\"", cpu);
+            registry_set_labels(perf_families[event], cpu, labels);
+        }
+    }
+
+    cpus = platform_cpu_count();
+    for (int kind = 0; kind < PROC_EVENT_KIND_COUNT; kind++)
+    {
+        const metric_def_t* def = &proc_defs[kind];
+        proc_families[kind] = registry_add_family(def->name, def->help, METRIC_TYPE_COUNTER, def->group, cpus);
+        if (proc_families[kind] < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            char labels[SERIES_LABELS_SIZE];
+            snprintf(labels, sizeof(labels), "cpu=\"%d\"", cpu);
+            registry_set_labels(proc_families[kind], cpu, labels);
+        }
+    }
+    proc_lost_family =
+        registry_add_family(proc_lost_def.name, proc_lost_def.help, METRIC_TYPE_COUNTER, proc_lost_def.group, 1);
+    if (proc_lost_family < 0)
     {
-        fprintf(stderr, "Error initializing Prometheus registry\n");
         return EXIT_FAILURE;
     }
 
-    // Create metrics
-    cpu_usage_metric = prom_gauge_new("cpu_usage_percentage", "CPU usage percentage", 0, NULL);
-    memory_usage_metric = prom_gauge_new("memory_usage_percentage", "Memory usage percentage", 0, NULL);
-    disk_io_reads_metric = prom_gauge_new("disk_io_reads", "Number of disk read sectors", 0, NULL);
-    disk_io_writes_metric = prom_gauge_new("disk_io_writes", "Number of disk write sectors", 0, NULL);
-    rx_bytes_metric = prom_gauge_new("network_rx_bytes", "Bytes received over the network", 0, NULL);
-    tx_bytes_metric = prom_gauge_new("network_tx_bytes", "Bytes transmitted over the network", 0, NULL);
-    rx_errors_metric = prom_gauge_new("network_rx_errors", "Network receive errors", 0, NULL);
-    tx_errors_metric = prom_gauge_new("network_tx_errors", "Network transmit errors", 0, NULL);
-    collisions_metric = prom_gauge_new("network_collisions", "Network collisions", 0, NULL);
-    process_count_metric = prom_gauge_new("process_count", "Number of running processes", 0, NULL);
-    context_switches_metric = prom_gauge_new("context_switches", "Number of context switches", 0, NULL);
+    cpus = platform_cpu_count();
+    for (int rate = 0; rate < SCHED_RATE_COUNT; rate++)
+    {
+        const metric_def_t* def = &sched_cpu_defs[rate];
+        sched_cpu_families[rate] = registry_add_family(def->name, def->help, METRIC_TYPE_GAUGE, def->group, cpus);
+        if (sched_cpu_families[rate] < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        for (int cpu = 0; cpu < cpus; cpu++)
+        {
+            char labels[SERIES_LABELS_SIZE];
+            snprintf(labels, sizeof(labels), "cpu=\"%d\"", cpu);
+            registry_set_labels(sched_cpu_families[rate], cpu, labels);
+        }
 
-    // Register metrics
-    prom_collector_registry_must_register_metric(cpu_usage_metric);
-    prom_collector_registry_must_register_metric(memory_usage_metric);
-    prom_collector_registry_must_register_metric(disk_io_reads_metric);
-    prom_collector_registry_must_register_metric(disk_io_writes_metric);
-    prom_collector_registry_must_register_metric(rx_bytes_metric);
-    prom_collector_registry_must_register_metric(tx_bytes_metric);
-    prom_collector_registry_must_register_metric(rx_errors_metric);
-    prom_collector_registry_must_register_metric(tx_errors_metric);
-    prom_collector_registry_must_register_metric(collisions_metric);
-    prom_collector_registry_must_register_metric(process_count_metric);
-    prom_collector_registry_must_register_metric(context_switches_metric);
+        def = &sched_task_defs[rate];
+        sched_task_families[rate] = registry_add_family(def->name, def->help, METRIC_TYPE_GAUGE, def->group,
+                                                        CONFIG_MAX_SCHEDSTAT_TOP_TASKS);
+        if (sched_task_families[rate] < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        for (int rank = 0; rank < CONFIG_MAX_SCHEDSTAT_TOP_TASKS; rank++)
+        {
+            char labels[SERIES_LABELS_SIZE];
+            snprintf(labels, sizeof(labels), "rank=\"%d\"", rank + 1);
+            registry_set_labels(sched_task_families[rate], rank, labels);
+        }
+        registry_set_active_series(sched_task_families[rate], 0); // Until /proc is first walked
+    }
 
-    return EXIT_SUCCESS;
+    sched_task_info_family = registry_add_family("process_sched_top_task_info",
+                                                 "Process holding each rank of the top scheduler rates",
+                                                 METRIC_TYPE_GAUGE, METRIC_GROUP_SCHEDSTAT,
+                                                 CONFIG_MAX_SCHEDSTAT_TOP_TASKS);
+    if (sched_task_info_family < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    for (int rank = 0; rank < CONFIG_MAX_SCHEDSTAT_TOP_TASKS; rank++)
+    {
+        registry_set(sched_task_info_family, rank, 1);
+    }
+    registry_set_active_series(sched_task_info_family, 0);
+
+    sample_rate_family = registry_add_family("collector_sample_rate_hertz",
+                                             "Effective sampling rate of each metric group", METRIC_TYPE_GAUGE,
+                                             METRIC_GROUP_ALWAYS, METRIC_GROUP_COUNT);
+    if (sample_rate_family < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    for (int group = 0; group < METRIC_GROUP_COUNT; group++)
+    {
+        char labels[SERIES_LABELS_SIZE];
+        snprintf(labels, sizeof(labels), "group=\"%s\"", config_group_key(group));
+        registry_set_labels(sample_rate_family, group, labels);
+    }
+
+    startup_family = registry_add_family("time_to_first_scrape_seconds",
+                                         "Time from agent start until valid metrics were ready to be scraped",
+                                         METRIC_TYPE_GAUGE, METRIC_GROUP_ALWAYS, 1);
+    if (startup_family < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (init_stream_stats() != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Preallocate output buffers, large enough for the registry or a full /proc_events ring;
+    // buffers this large come from mmap, so pages a response never writes cost no RSS
+    scrape_buffer_size = registry_render_bound();
+    if (scrape_buffer_size < (size_t)CONFIG_MAX_PROC_EVENTS_RING * PROC_EVENTS_LINE_SIZE)
+    {
+        scrape_buffer_size = (size_t)CONFIG_MAX_PROC_EVENTS_RING * PROC_EVENTS_LINE_SIZE;
+    }
+    for (int i = 0; i < SCRAPE_BUFFERS; i++)
+    {
+        scrape_buffers[i].data = malloc(scrape_buffer_size);
+        if (scrape_buffers[i].data == NULL)
+        {
+            fprintf(stderr, "Error allocating scrape buffers\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const monitor_config_t* config = config_acquire();
+    if (config == NULL)
+    {
+        fprintf(stderr, "Error initializing metrics: no configuration loaded\n");
+        return EXIT_FAILURE;
+    }
+
+    int ret = reconcile_metrics(config);
+    config_release(config);
+
+    return ret;
 }
 
 /**
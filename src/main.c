@@ -3,7 +3,18 @@
  * @brief Entry point of the system
  */
 
+#include "alloc_check.h"
+#include "collector.h"
 #include "expose_metrics.h"
+#include "perf_events.h"
+#include "platform.h"
+#include "sampler.h"
+#include <poll.h>
+#ifdef ALLOC_CHECK
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,8 +22,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
-#include "../include/monitor.h"  // Para la integración con el TP2
-#include <cjson/cJSON.h>  // Include cJSON library
+#include <time.h>
 
 /**
  * @def SLEEP_TIME
@@ -22,6 +32,14 @@
  */
 #define SLEEP_TIME 1
 
+/**
+ * @brief Tiempo objetivo desde el inicio hasta el primer scrape válido, en milisegundos.
+ *
+ * Si el arranque lo supera se informa por stderr; el valor medido se expone siempre en
+ * time_to_first_scrape_seconds.
+ */
+#define STARTUP_TARGET_MS 50
+
 /**
  * @brief Señal para recargar la configuración.
  */
@@ -32,21 +50,6 @@ volatile sig_atomic_t reload_config = 0;
  */
 volatile sig_atomic_t stop_program = 0;
 
-/**
- * @brief Variables booleanas para controlar qué métricas se deben mostrar.
- */
-bool show_cpu_usage = true;
-bool show_memory_usage = true;
-bool show_disk_io = true;
-bool show_network_stats = true;
-bool show_process_count = true;
-bool show_context_switches = true;
-
-/**
- * @brief Intervalo de tiempo entre actualizaciones de métricas.
- */
-int interval = 5;
-
 /**
  * @brief Manejador de señales para recargar la configuración o detener el programa.
  *
@@ -65,61 +68,229 @@ void handle_signal(int signal)
 }
 
 /**
- * @brief Lee la configuración desde un archivo JSON.
+ * @brief Recarga la configuración y ajusta las métricas expuestas.
+ *
+ * Si el archivo no existe o es inválido se conserva la configuración actual.
  *
  * @param config_filename Nombre del archivo de configuración.
  */
-void read_config(const char* config_filename)
+void reload(const char* config_filename)
 {
-    FILE* file = fopen(config_filename, "r");
-    if (file == NULL)
+    monitor_config_t* config = config_load(config_filename);
+    if (config == NULL)
     {
-        perror("Error al abrir el archivo de configuración, usando métricas por defecto");
-        // Usar métricas por defecto
+        fprintf(stderr, "Configuración inválida, se conserva la configuración actual\n");
         return;
     }
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    config_publish(config);
 
-    char* data = (char*)malloc(length + 1);
-    fread(data, 1, length, file);
-    fclose(file);
-    data[length] = '\0';
+    const monitor_config_t* current = config_acquire();
+    reconcile_collection(current);
+    config_release(current);
+}
 
-    cJSON* json = cJSON_Parse(data);
-    if (json == NULL)
+/**
+ * @brief Espera hasta el próximo intervalo o hasta que cambie el archivo de configuración.
+ *
+ * La espera también se interrumpe al recibir una señal (SIGUSR1 o SIGINT).
+ *
+ * @param watch_fd Descriptor inotify (puede ser -1).
+ * @param timeout_ms Tiempo máximo de espera en milisegundos (-1 espera sólo eventos).
+ */
+void wait_next_interval(int watch_fd, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = watch_fd, .events = POLLIN};
+
+    if (poll(&pfd, 1, timeout_ms) > 0 && config_watch_changed(watch_fd))
     {
-        perror("Error al parsear el archivo JSON, usando métricas por defecto");
-        free(data);
-        return;
+        reload_config = 1;
     }
+}
 
-    cJSON* metrics_json = cJSON_GetObjectItemCaseSensitive(json, "metrics");
-    cJSON* interval_json = cJSON_GetObjectItemCaseSensitive(json, "interval");
+#ifdef ALLOC_CHECK
+/**
+ * @brief Encabezado Accept que negocia cada formato de exposición, indexado por registry_format_t.
+ */
+static const char* const alloc_check_accept[] = {
+    [REGISTRY_FORMAT_TEXT] = "text/plain; version=0.0.4",
+    [REGISTRY_FORMAT_OPENMETRICS] = "application/openmetrics-text; version=1.0.0",
+    [REGISTRY_FORMAT_PROTOBUF] = "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; "
+                                 "encoding=delimited",
+};
+
+/**
+ * @brief Hace un scrape completo de /metrics por HTTP contra el servidor local y descarta la respuesta.
+ *
+ * @param format Formato a negociar con el encabezado Accept.
+ * @return EXIT_SUCCESS si el servidor respondió 200, EXIT_FAILURE en caso contrario.
+ */
+static int scrape_over_http(registry_format_t format)
+{
+    static char response[4096];
+    char request[256];
+    int status = EXIT_FAILURE;
 
-    if (!cJSON_IsObject(metrics_json) || !cJSON_IsNumber(interval_json))
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
     {
-        perror("Formato de archivo JSON inválido, usando métricas por defecto");
-        cJSON_Delete(json);
-        free(data);
-        return;
+        return EXIT_FAILURE;
     }
 
-    show_cpu_usage = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "cpu"));
-    show_memory_usage = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "memory"));
-    show_disk_io = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "disk_io"));
-    show_network_stats = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "network_stats"));
-    show_process_count = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "process_count"));
-    show_context_switches = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(metrics_json, "context_switches"));
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(HTTP_PORT)};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0)
+    {
+        goto out;
+    }
 
-    interval = interval_json->valueint;
+    int length = snprintf(request, sizeof(request), "GET /metrics HTTP/1.0\r\nAccept: %s\r\n\r\n",
+                          alloc_check_accept[format]);
+    if (send(fd, request, (size_t)length, MSG_NOSIGNAL) != length)
+    {
+        goto out;
+    }
+
+    // La línea de estado llega en la primera lectura; el resto de la respuesta se descarta
+    ssize_t chunk = recv(fd, response, sizeof(response), 0);
+    bool ok = chunk >= 12 && strncmp(response, "HTTP/1.", 7) == 0 && strncmp(response + 9, "200", 3) == 0;
+    while (chunk > 0)
+    {
+        chunk = recv(fd, response, sizeof(response), 0);
+    }
+    if (ok && chunk == 0)
+    {
+        status = EXIT_SUCCESS;
+    }
 
-    cJSON_Delete(json);
-    free(data);
+out:
+    close(fd);
+    return status;
 }
 
+/**
+ * @brief Verifica que la recolección y el scrape no asignen memoria en régimen estable.
+ *
+ * La primera fase ejecuta ALLOC_CHECK_WARMUP ciclos de calentamiento y luego cuenta las
+ * asignaciones de ALLOC_CHECK_ROUNDS ciclos, cada uno seguido de una serialización completa
+ * en uno de los formatos de exposición; esta fase debe dar cero.
+ *
+ * La segunda fase abre el servidor HTTP y repite la cuenta con scrapes reales de /metrics
+ * sobre el loopback, que recorren handle_request() y la creación de la respuesta. Ni el
+ * código del agente ni los buffers de scrape asignan en ese camino, pero libmicrohttpd
+ * reserva por conexión su estado interno y el objeto MHD_Response; esas asignaciones son
+ * ajenas al agente y se informan sin hacer fallar la verificación.
+ *
+ * @return EXIT_SUCCESS si la primera fase no asignó memoria y todos los scrapes HTTP
+ *         respondieron 200, EXIT_FAILURE en caso contrario.
+ */
+int run_alloc_check()
+{
+    size_t length = 0;
+
+    for (int round = 0; round < ALLOC_CHECK_WARMUP + ALLOC_CHECK_ROUNDS; round++)
+    {
+        if (round == ALLOC_CHECK_WARMUP)
+        {
+            alloc_check_start();
+        }
+
+        collect_metrics(0);
+        char* body = render_scrape((registry_format_t)(round % 3), &length); // Alternar los tres formatos
+        if (body == NULL)
+        {
+            alloc_check_stop();
+            fprintf(stderr, "Error al serializar las métricas\n");
+            return EXIT_FAILURE;
+        }
+        release_scrape(body);
+    }
+
+    size_t allocations = alloc_check_stop();
+    printf("Asignaciones en %d ciclos y scrapes: %zu\n", ALLOC_CHECK_ROUNDS, allocations);
+
+    if (start_http_server() != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (int round = 0; round < ALLOC_CHECK_WARMUP + ALLOC_CHECK_ROUNDS; round++)
+    {
+        if (round == ALLOC_CHECK_WARMUP)
+        {
+            alloc_check_start();
+        }
+
+        if (scrape_over_http((registry_format_t)(round % 3)) != EXIT_SUCCESS)
+        {
+            alloc_check_stop();
+            stop_http_server();
+            fprintf(stderr, "Error en el scrape HTTP de /metrics\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t http_allocations = alloc_check_stop();
+    stop_http_server();
+    printf("Asignaciones en %d scrapes HTTP: %zu (%.1f por scrape, de libmicrohttpd)\n", ALLOC_CHECK_ROUNDS,
+           http_allocations, (double)http_allocations / ALLOC_CHECK_ROUNDS);
+
+    return allocations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+#ifdef PERF_BENCH
+/**
+ * @brief Nanosegundos entre dos instantes de CLOCK_MONOTONIC.
+ */
+static double elapsed_ns(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * @brief Compara el costo de leer /proc/stat con el de leer los contadores de perf_event_open.
+ *
+ * Mide PERF_BENCH_ROUNDS lecturas de cada camino: get_ctxt(), que parsea el texto de
+ * /proc/stat para obtener un único contador global, y perf_events_read(), que obtiene
+ * los cuatro eventos de cada CPU con un read() por CPU.
+ *
+ * @return EXIT_SUCCESS si se midieron ambos caminos, EXIT_FAILURE si perf no está disponible.
+ */
+int run_perf_bench()
+{
+    static uint64_t counts[PLATFORM_MAX_CPUS][PERF_EVENT_COUNT];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < PERF_BENCH_ROUNDS; round++)
+    {
+        metrics_tick_reset();
+        get_ctxt();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("/proc/stat (ctxt): %.0f ns por lectura\n", elapsed_ns(&start, &end) / PERF_BENCH_ROUNDS);
+
+    if (perf_events_open() != 0)
+    {
+        printf("perf_event_open no disponible, sólo se midió /proc/stat\n");
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < PERF_BENCH_ROUNDS; round++)
+    {
+        perf_events_read(counts);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("perf_event_open (%d CPUs, %d eventos): %.0f ns por lectura\n", platform_cpu_count(),
+           PERF_EVENT_COUNT, elapsed_ns(&start, &end) / PERF_BENCH_ROUNDS);
+
+    perf_events_close();
+    return EXIT_SUCCESS;
+}
+#endif
+
 /**
  * @brief Punto de entrada del programa.
  *
@@ -129,6 +300,9 @@ void read_config(const char* config_filename)
  */
 int main(int argc, char* argv[])
 {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
     signal(SIGUSR1, handle_signal);  // Configurar el manejador de señales
     signal(SIGINT, handle_signal);
 
@@ -138,19 +312,68 @@ int main(int argc, char* argv[])
     }
 
     const char* config_filename = argv[1];
+    platform_init();
 
     // Leer la configuración inicial
-    read_config(config_filename);
+    monitor_config_t* initial = config_load(config_filename);
+    if (initial == NULL)
+    {
+        fprintf(stderr, "Usando métricas por defecto\n");
+        initial = config_defaults();
+        if (initial == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    config_publish(initial);
+
+#ifdef ALLOC_CHECK
+    if (init_metrics() != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    return run_alloc_check();
+#endif
+
+#ifdef PERF_BENCH
+    return run_perf_bench();
+#endif
+
+    // Vigilar el archivo de configuración para recargarlo al modificarse
+    int watch_fd = config_watch_init(config_filename);
+
+    // Arranque determinístico: registro y buffers, muestra de referencia, primera muestra
+    // válida y recién entonces el puerto HTTP, para que ningún scrape vea valores a medio armar
+    if (init_metrics() != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Creamos un hilo para el muestreo de alta frecuencia de las estadísticas en flujo
+    pthread_t sampler_tid;
+    if (pthread_create(&sampler_tid, NULL, sample_metrics, NULL) != 0)
+    {
+        fprintf(stderr, "Error al crear el hilo de muestreo\n");
+        return EXIT_FAILURE;
+    }
 
-    // Creamos un hilo para exponer las métricas vía HTTP
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, expose_metrics, NULL) != 0)
+    prime_metrics();
+
+    if (start_http_server() != EXIT_SUCCESS)
     {
-        fprintf(stderr, "Error al crear el hilo del servidor HTTP\n");
         return EXIT_FAILURE;
     }
 
-    init_metrics();
+    // Medir hasta que el puerto acepta scrapes, incluyendo la apertura del servidor HTTP
+    struct timespec ready;
+    clock_gettime(CLOCK_MONOTONIC, &ready);
+    double startup_s = (ready.tv_sec - started.tv_sec) + (ready.tv_nsec - started.tv_nsec) / 1e9;
+    update_startup_gauge(startup_s);
+    if (startup_s * 1000 > STARTUP_TARGET_MS)
+    {
+        fprintf(stderr, "El primer scrape válido demoró %.0f ms (objetivo: %d ms)\n", startup_s * 1000,
+                STARTUP_TARGET_MS);
+    }
 
     // Bucle principal para actualizar las métricas según el intervalo especificado
     while (!stop_program)
@@ -158,39 +381,20 @@ int main(int argc, char* argv[])
         if (reload_config)
         {
             // Volver a leer la configuración
-            read_config(config_filename);
             reload_config = 0;
+            reload(config_filename);
         }
 
-        // Actualizar las métricas según las configuraciones
-        if (show_cpu_usage)
-        {
-            update_cpu_gauge();
-        }
-        if (show_memory_usage)
-        {
-            update_memory_gauge();
-            update_memory_gauge2();
-        }
-        if (show_disk_io)
-        {
-            update_disk_io_gauge();
-        }
-        if (show_network_stats)
-        {
-            update_network_gauge();
-        }
-        if (show_process_count)
-        {
-            update_process_count_gauge();
-        }
-        if (show_context_switches)
-        {
-            update_context_switches_gauge();
-        }
+        const monitor_config_t* config = config_acquire();
+        bool on_scrape = config->collect_on_scrape || config->upstream_count > 0;
+        config_release(config);
+
+        // Actualizar los grupos que vencieron; en modo a demanda o de federación se actualiza cada scrape
+        int timeout_ms = on_scrape ? -1 : collect_scheduled_metrics();
 
-        sleep(interval);  // Esperar el tiempo especificado en el intervalo
+        wait_next_interval(watch_fd, timeout_ms); // Esperar el próximo vencimiento o un cambio de configuración
     }
 
+    stop_http_server();
     return EXIT_SUCCESS;
 }
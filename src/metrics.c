@@ -1,36 +1,145 @@
 #include "../include/metrics.h"
+#include <fcntl.h>
+#include <stdbool.h>
+
+/** Arena para el contenido de los archivos de /proc leídos durante un ciclo, una por hilo */
+static __thread arena_t proc_arena;
+
+/** Memoria que la arena dejó al crecer; sigue siendo válida hasta el próximo reset */
+static __thread char* retired_blocks[PROC_ARENA_GROWTHS];
+static __thread int retired_count;
+
+_Static_assert(((size_t)PROC_ARENA_INITIAL_SIZE << PROC_ARENA_GROWTHS) == PROC_ARENA_MAX_SIZE,
+               "PROC_ARENA_GROWTHS duplicaciones deben llevar la arena a PROC_ARENA_MAX_SIZE");
+
+void metrics_tick_reset()
+{
+    for (int i = 0; i < retired_count; i++)
+    {
+        free(retired_blocks[i]);
+    }
+    retired_count = 0;
+    arena_reset(&proc_arena);
+}
+
+/**
+ * @brief Duplica la capacidad de la arena del hilo, hasta PROC_ARENA_MAX_SIZE.
+ *
+ * Los archivos ya leídos en el ciclo quedan en la memoria anterior, que se libera en el
+ * próximo metrics_tick_reset(). Como la arena sólo crece, esto ocurre a lo sumo
+ * PROC_ARENA_GROWTHS veces en la vida del hilo.
+ *
+ * @return 0 si la arena creció, o -1 si ya estaba en el máximo o no hay memoria.
+ */
+static int grow_proc_arena()
+{
+    arena_t grown;
+
+    if (proc_arena.capacity >= PROC_ARENA_MAX_SIZE || arena_init(&grown, proc_arena.capacity * 2) != 0)
+    {
+        return -1;
+    }
+    retired_blocks[retired_count++] = proc_arena.base;
+    proc_arena = grown;
+
+    return 0;
+}
+
+char* read_proc_file(const char* path)
+{
+    if (proc_arena.base == NULL && arena_init(&proc_arena, PROC_ARENA_INITIAL_SIZE) != 0)
+    {
+        fprintf(stderr, "Error allocating /proc arena\n");
+        return NULL;
+    }
+
+    do
+    {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return NULL;
+        }
+
+        size_t available;
+        char* data = arena_reserve(&proc_arena, &available);
+        size_t length = 0;
+        ssize_t n;
+
+        while (length + 1 < available && (n = read(fd, data + length, available - length - 1)) > 0)
+        {
+            length += n;
+        }
+        close(fd);
+
+        if (available > 0 && length + 1 < available)
+        {
+            data[length] = '\0';
+            arena_commit(&proc_arena, length + 1);
+            return data;
+        }
+    } while (grow_proc_arena() == 0); // No entró: volver a leerlo en una arena más grande
+
+    fprintf(stderr, "%s does not fit in the /proc arena\n", path);
+    return NULL;
+}
+
+/**
+ * @brief Devuelve la próxima línea de un buffer y avanza el cursor.
+ *
+ * @param[in,out] cursor Posición actual; queda apuntando a la línea siguiente.
+ * @return Línea terminada en '\0' (sin el '\n'), o NULL al llegar al final.
+ */
+static char* next_line(char** cursor)
+{
+    char* line = *cursor;
+    if (line == NULL || *line == '\0')
+    {
+        return NULL;
+    }
+
+    char* end = strchr(line, '\n');
+    if (end != NULL)
+    {
+        *end = '\0';
+        *cursor = end + 1;
+    }
+    else
+    {
+        *cursor = line + strlen(line);
+    }
+
+    return line;
+}
 
 unsigned long long int get_ctxt()
 {
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
-    unsigned long long ctxt;
+    char* line;
+    unsigned long long ctxt = 0;
 
-    // Abrir el archivo /proc/stat
-    fp = fopen("/proc/stat", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/stat
+    char* cursor = read_proc_file("/proc/stat");
+    if (cursor == NULL)
     {
         perror("Error opening /proc/stat"); // Registra un error si no se puede abrir el archivo
-        return 1;
+        return (unsigned long long)-1;
     }
 
     // Leer el valor total de cambios de contexto desde el archivo
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    while ((line = next_line(&cursor)) != NULL)
     {
-        if (sscanf(buffer, "ctxt %llu", &ctxt) == 1) // Extrae el valor "ctxt" del buffer
+        if (sscanf(line, "ctxt %llu", &ctxt) == 1) // Extrae el valor "ctxt" de la línea
         {
             break;
         }
     }
 
-    fclose(fp);
-
     // Verifica si el valor de los cambios de contexto fue recuperado con éxito
     if (ctxt == 0)
     {
         fprintf(stderr,
                 "Error reading context switch information from /proc/stat\n"); // Registra un error si no se encuentra el valor
-        return 1;
+        return (unsigned long long)-1;
     }
 
     return ctxt; // Devuelve el número de cambios de contexto recuperado
@@ -38,33 +147,30 @@ unsigned long long int get_ctxt()
 
 double get_memory_usage()
 {
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
+    char* line;
     unsigned long long total_mem = 0, free_mem = 0;
 
-    // Abrir el archivo /proc/meminfo
-    fp = fopen("/proc/meminfo", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/meminfo
+    char* cursor = read_proc_file("/proc/meminfo");
+    if (cursor == NULL)
     {
         perror("Error opening /proc/meminfo"); // Registra un error si no se puede abrir el archivo
         return -1.0;
     }
 
     // Leer los valores de memoria total y disponible
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    while ((line = next_line(&cursor)) != NULL)
     {
-        if (sscanf(buffer, "MemTotal: %llu kB", &total_mem) == 1)
+        if (sscanf(line, "MemTotal: %llu kB", &total_mem) == 1)
         {
             continue; // MemTotal encontrado, continuar leyendo para MemAvailable
         }
-        if (sscanf(buffer, "MemAvailable: %llu kB", &free_mem) == 1)
+        if (sscanf(line, "MemAvailable: %llu kB", &free_mem) == 1)
         {
             break; // MemAvailable encontrado, detener la lectura
         }
     }
 
-    fclose(fp);
-
     // Verifica si ambos valores fueron recuperados con éxito
     if (total_mem == 0 || free_mem == 0)
     {
@@ -79,92 +185,162 @@ double get_memory_usage()
     return mem_usage_percent; // Devuelve el porcentaje de memoria utilizada
 }
 
-double get_cpu_usage()
+int get_cpu_times(cpu_times_t* times)
 {
-    static unsigned long long prev_user = 0, prev_nice = 0, prev_system = 0, prev_idle = 0, prev_iowait = 0,
-                              prev_irq = 0, prev_softirq = 0, prev_steal = 0;
-    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
-    unsigned long long totald, idled;
-    double cpu_usage_percent;
-
-    // Abrir el archivo /proc/stat
-    FILE* fp = fopen("/proc/stat", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/stat; la primera línea tiene los tiempos agregados de todas las CPUs
+    char* buffer = read_proc_file("/proc/stat");
+    if (buffer == NULL)
     {
         perror("Error opening /proc/stat"); // Registra un error si no se puede abrir el archivo
-        return -1.0;
-    }
-
-    char buffer[BUFFER_SIZE * 4];
-    if (fgets(buffer, sizeof(buffer), fp) == NULL)
-    {
-        perror("Error reading /proc/stat"); // Registra un error si no se puede leer el archivo
-        fclose(fp);
-        return -1.0;
+        return -1;
     }
-    fclose(fp);
 
     // Parsear los valores del tiempo de CPU del archivo
-    int ret = sscanf(buffer, "cpu  %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle, &iowait,
-                     &irq, &softirq, &steal);
+    int ret = sscanf(buffer, "cpu  %llu %llu %llu %llu %llu %llu %llu %llu", &times->user, &times->nice,
+                     &times->system, &times->idle, &times->iowait, &times->irq, &times->softirq, &times->steal);
     if (ret < 8)
     {
         fprintf(stderr, "Error parsing /proc/stat\n"); // Registra un error si el análisis falla
-        return -1.0;
+        return -1;
     }
 
+    return 0;
+}
+
+double cpu_usage_between(const cpu_times_t* prev, const cpu_times_t* cur)
+{
     // Calcular las diferencias entre las lecturas actuales y anteriores
-    unsigned long long prev_idle_total = prev_idle + prev_iowait;
-    unsigned long long idle_total = idle + iowait;
+    unsigned long long prev_idle_total = prev->idle + prev->iowait;
+    unsigned long long idle_total = cur->idle + cur->iowait;
 
-    unsigned long long prev_non_idle = prev_user + prev_nice + prev_system + prev_irq + prev_softirq + prev_steal;
-    unsigned long long non_idle = user + nice + system + irq + softirq + steal;
+    unsigned long long prev_non_idle =
+        prev->user + prev->nice + prev->system + prev->irq + prev->softirq + prev->steal;
+    unsigned long long non_idle = cur->user + cur->nice + cur->system + cur->irq + cur->softirq + cur->steal;
 
     unsigned long long prev_total = prev_idle_total + prev_non_idle;
     unsigned long long total = idle_total + non_idle;
 
-    totald = total - prev_total;
-    idled = idle_total - prev_idle_total;
+    unsigned long long totald = total - prev_total;
+    unsigned long long idled = idle_total - prev_idle_total;
 
     if (totald == 0)
     {
-        fprintf(stderr, "Totald is zero, cannot calculate CPU usage!\n"); // Registra un error si no hay diferencia en el tiempo total
-        return -1.0;
+        return -1.0; // No hay diferencia en el tiempo total
     }
 
     // Calcular el porcentaje de uso de la CPU
-    cpu_usage_percent = ((double)(totald - idled) / totald) * 100.0;
+    return ((double)(totald - idled) / totald) * 100.0;
+}
+
+int get_pressure_totals(const char* resource, unsigned long long totals[2])
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/pressure/%s", resource);
+
+    // Sin mensajes de error: PSI falta en kernels sin CONFIG_PSI o arrancados con psi=0
+    char* cursor = read_proc_file(path);
+    if (cursor == NULL)
+    {
+        return -1;
+    }
+
+    char* line;
+    int lines = 0;
+    while (lines < 2 && (line = next_line(&cursor)) != NULL)
+    {
+        const char* total = strstr(line, "total=");
+        if (total == NULL || sscanf(total, "total=%llu", &totals[lines]) != 1)
+        {
+            break;
+        }
+        lines++;
+    }
+
+    return lines > 0 ? lines : -1;
+}
+
+/** Lectura anterior de get_cpu_usage() */
+static cpu_times_t prev_cpu;
+
+/** Indica si prev_cpu tiene una lectura válida */
+static bool has_prev_cpu;
+
+int prime_cpu_usage()
+{
+    if (get_cpu_times(&prev_cpu) != 0)
+    {
+        return -1;
+    }
+
+    has_prev_cpu = true;
+    return 0;
+}
+
+/**
+ * @brief Suma de todos los tiempos de una lectura, en jiffies.
+ */
+static unsigned long long total_jiffies(const cpu_times_t* times)
+{
+    return times->user + times->nice + times->system + times->idle + times->iowait + times->irq + times->softirq +
+           times->steal;
+}
+
+long long cpu_usage_elapsed_jiffies()
+{
+    cpu_times_t cur;
+
+    if (!has_prev_cpu || get_cpu_times(&cur) != 0)
+    {
+        return -1;
+    }
+
+    return (long long)(total_jiffies(&cur) - total_jiffies(&prev_cpu));
+}
+
+double get_cpu_usage()
+{
+    cpu_times_t cur;
+
+    if (!has_prev_cpu)
+    {
+        // Sin lectura de referencia el resultado sería el uso promedio desde el arranque
+        prime_cpu_usage();
+        return -1.0;
+    }
+    if (get_cpu_times(&cur) != 0)
+    {
+        return -1.0;
+    }
+
+    double cpu_usage_percent = cpu_usage_between(&prev_cpu, &cur);
+    if (cpu_usage_percent < 0)
+    {
+        fprintf(stderr, "Totald is zero, cannot calculate CPU usage!\n"); // Registra un error si no hay diferencia en el tiempo total
+        return -1.0;
+    }
 
     // Actualizar los valores previos para la próxima lectura
-    prev_user = user;
-    prev_nice = nice;
-    prev_system = system;
-    prev_idle = idle;
-    prev_iowait = iowait;
-    prev_irq = irq;
-    prev_softirq = softirq;
-    prev_steal = steal;
+    prev_cpu = cur;
 
     return cpu_usage_percent; // Devuelve el porcentaje de uso de la CPU
 }
 
-void get_disk_io(unsigned long long* reads, unsigned long long* writes)
+int get_disk_io(unsigned long long* reads, unsigned long long* writes)
 {
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
+    char* buffer;
     *reads = 0;
     *writes = 0;
 
-    // Abrir el archivo /proc/diskstats para leer
-    fp = fopen("/proc/diskstats", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/diskstats
+    char* cursor = read_proc_file("/proc/diskstats");
+    if (cursor == NULL)
     { // Verifica si ocurrió un error al abrir el archivo
         perror("Error opening /proc/diskstats");
-        return;
+        return -1;
     }
 
     // Leer cada línea del archivo hasta llegar al final
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    while ((buffer = next_line(&cursor)) != NULL)
     {
         unsigned long long read_sectors = 0, write_sectors = 0;
         int major, minor;         // Números de dispositivo
@@ -181,34 +357,33 @@ void get_disk_io(unsigned long long* reads, unsigned long long* writes)
         *writes += write_sectors;
     }
 
-    fclose(fp); // Cerrar el archivo para liberar recursos
+    return 0;
 }
 
-void get_network_stats(unsigned long long* rx_bytes, unsigned long long* tx_bytes, unsigned long long* rx_errors,
-                       unsigned long long* tx_errors, unsigned long long* collisions)
+int get_network_stats(unsigned long long* rx_bytes, unsigned long long* tx_bytes, unsigned long long* rx_errors,
+                      unsigned long long* tx_errors, unsigned long long* collisions)
 {
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
+    char* buffer;
     *rx_bytes = 0;   // Total de bytes recibidos
     *tx_bytes = 0;   // Total de bytes transmitidos
     *rx_errors = 0;  // Total de errores de recepción
     *tx_errors = 0;  // Total de errores de transmisión
     *collisions = 0; // Total de colisiones
 
-    // Abrir el archivo /proc/net/dev para leer
-    fp = fopen("/proc/net/dev", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/net/dev
+    char* cursor = read_proc_file("/proc/net/dev");
+    if (cursor == NULL)
     { // Verifica si ocurrió un error al abrir el archivo
         perror("Error opening /proc/net/dev");
-        return;
+        return -1;
     }
 
     // Omitir las primeras dos líneas del encabezado
-    fgets(buffer, sizeof(buffer), fp);
-    fgets(buffer, sizeof(buffer), fp);
+    next_line(&cursor);
+    next_line(&cursor);
 
     // Leer cada línea del archivo hasta llegar al final
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    while ((buffer = next_line(&cursor)) != NULL)
     {
         char interface[BUFFER_SIZE]; // Nombre de la interfaz
         unsigned long long r_bytes, r_packets, r_errors, r_drop, r_fifo, r_frame, r_compressed, r_multicast;
@@ -227,25 +402,24 @@ void get_network_stats(unsigned long long* rx_bytes, unsigned long long* tx_byte
         *collisions += t_colls;
     }
 
-    fclose(fp); // Cerrar el archivo para liberar recursos
+    return 0;
 }
 
 int get_process()
 {
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
+    char* buffer;
     int process_count = 0; // Inicializar contador de procesos a cero
 
-    // Abrir el archivo /proc/stat para leer
-    fp = fopen("/proc/stat", "r");
-    if (fp == NULL)
+    // Leer el archivo /proc/stat
+    char* cursor = read_proc_file("/proc/stat");
+    if (cursor == NULL)
     { // Verifica si ocurrió un error al abrir el archivo
         perror("Error opening /proc/stat");
         return -1; // Devuelve -1 en caso de error
     }
 
     // Leer cada línea del archivo hasta llegar al final
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    while ((buffer = next_line(&cursor)) != NULL)
     {
         // Intentar extraer el número de procesos en ejecución
         if (sscanf(buffer, "procs_running %d", &process_count) == 1)
@@ -254,6 +428,5 @@ int get_process()
         }
     }
 
-    fclose(fp);           // Cerrar el archivo para liberar recursos
     return process_count; // Devuelve el número de procesos en ejecución
 }
@@ -0,0 +1,184 @@
+#include "../include/perf_events.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** Evento de software del kernel de cada perf_event_id_t */
+static const uint64_t event_configs[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CONTEXT_SWITCHES] = PERF_COUNT_SW_CONTEXT_SWITCHES,
+    [PERF_EVENT_CPU_MIGRATIONS] = PERF_COUNT_SW_CPU_MIGRATIONS,
+    [PERF_EVENT_PAGE_FAULTS] = PERF_COUNT_SW_PAGE_FAULTS,
+    [PERF_EVENT_MAJOR_FAULTS] = PERF_COUNT_SW_PAGE_FAULTS_MAJ,
+};
+
+/** Resultado de read() sobre un líder con PERF_FORMAT_GROUP */
+typedef struct
+{
+    uint64_t nr;
+    uint64_t values[PERF_EVENT_COUNT];
+} group_read_t;
+
+/** Descriptores de cada CPU y evento; -1 si no está abierto */
+static int event_fds[PLATFORM_MAX_CPUS][PERF_EVENT_COUNT];
+
+/** Indica si los grupos están abiertos */
+static bool opened;
+
+/**
+ * @brief Lee /proc/sys/kernel/perf_event_paranoid para explicar un rechazo.
+ *
+ * @return Nivel configurado, o -2 si no se puede leer.
+ */
+static int read_paranoid()
+{
+    int level = -2;
+    FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &level) != 1)
+        {
+            level = -2;
+        }
+        fclose(file);
+    }
+
+    return level;
+}
+
+/**
+ * @brief Abre un evento de software que cuenta todos los procesos de una CPU.
+ */
+static int open_event(uint64_t config, int cpu, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = group_fd == -1; // El líder arranca detenido y habilita todo el grupo junto
+
+    return (int)syscall(SYS_perf_event_open, &attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * @brief Cierra todos los descriptores abiertos, incluso los de una apertura fallida.
+ */
+static void close_events()
+{
+    for (int cpu = 0; cpu < PLATFORM_MAX_CPUS; cpu++)
+    {
+        for (int event = PERF_EVENT_COUNT - 1; event >= 0; event--)
+        {
+            if (event_fds[cpu][event] >= 0)
+            {
+                close(event_fds[cpu][event]);
+                event_fds[cpu][event] = -1;
+            }
+        }
+    }
+}
+
+int perf_events_open()
+{
+    if (opened)
+    {
+        return 0;
+    }
+
+    int cpus = platform_cpu_count();
+    int open_groups = 0;
+
+    for (int cpu = 0; cpu < PLATFORM_MAX_CPUS; cpu++)
+    {
+        for (int event = 0; event < PERF_EVENT_COUNT; event++)
+        {
+            event_fds[cpu][event] = -1;
+        }
+    }
+
+    for (int cpu = 0; cpu < cpus; cpu++)
+    {
+        int* fds = event_fds[cpu];
+        fds[0] = open_event(event_configs[0], cpu, -1);
+        if (fds[0] < 0)
+        {
+            if (errno == ENODEV)
+            {
+                continue; // CPU fuera de línea
+            }
+            if (errno == EACCES || errno == EPERM)
+            {
+                fprintf(stderr, "perf_event_paranoid=%d forbids system-wide perf events, using /proc/stat\n",
+                        read_paranoid());
+            }
+            else
+            {
+                perror("perf_event_open");
+            }
+            close_events();
+            return -1;
+        }
+
+        for (int event = 1; event < PERF_EVENT_COUNT; event++)
+        {
+            fds[event] = open_event(event_configs[event], cpu, fds[0]);
+            if (fds[event] < 0)
+            {
+                perror("perf_event_open");
+                close_events();
+                return -1;
+            }
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        open_groups++;
+    }
+
+    opened = open_groups > 0;
+    return opened ? 0 : -1;
+}
+
+void perf_events_close()
+{
+    if (opened)
+    {
+        close_events();
+        opened = false;
+    }
+}
+
+bool perf_events_available()
+{
+    return opened;
+}
+
+int perf_events_read(uint64_t counts[PLATFORM_MAX_CPUS][PERF_EVENT_COUNT])
+{
+    if (!opened)
+    {
+        return -1;
+    }
+
+    int cpus = platform_cpu_count();
+    for (int cpu = 0; cpu < cpus; cpu++)
+    {
+        group_read_t group = {0};
+        int leader = event_fds[cpu][0];
+
+        if (leader >= 0 && (read(leader, &group, sizeof(group)) != (ssize_t)sizeof(group) ||
+                            group.nr != PERF_EVENT_COUNT))
+        {
+            perror("Error reading perf events");
+            return -1;
+        }
+        memcpy(counts[cpu], group.values, sizeof(group.values));
+    }
+
+    return 0;
+}
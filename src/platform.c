@@ -0,0 +1,39 @@
+#include "../include/platform.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+int64_t platform_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static atomic_int cpu_count;
+
+int platform_init()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpus < 1)
+    {
+        cpus = 1;
+    }
+    if (cpus > PLATFORM_MAX_CPUS)
+    {
+        fprintf(stderr, "%ld CPUs configured, only the first %d are monitored\n", cpus, PLATFORM_MAX_CPUS);
+        cpus = PLATFORM_MAX_CPUS;
+    }
+    atomic_store(&cpu_count, (int)cpus);
+
+    return (int)cpus;
+}
+
+int platform_cpu_count()
+{
+    int cpus = atomic_load_explicit(&cpu_count, memory_order_relaxed);
+
+    return cpus > 0 ? cpus : platform_init();
+}
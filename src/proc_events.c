@@ -0,0 +1,487 @@
+#include "../include/proc_events.h"
+#include "../include/config.h"
+#include <errno.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Tamaño del buffer de recepción: varios mensajes del conector por recv() */
+#define RECEIVE_BUFFER_SIZE 8192
+
+/** Buffer del socket en el kernel: absorbe ráfagas de fork/exit sin desbordarse (ENOBUFS) */
+#define SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+
+/** Espera máxima de la confirmación de PROC_CN_MCAST_LISTEN, en milisegundos */
+#define ACK_TIMEOUT_MS 200
+
+/** Contadores de una CPU, alineados a una línea de caché para no compartirla con otra */
+typedef struct
+{
+    _Alignas(64) _Atomic uint64_t counts[PROC_EVENT_KIND_COUNT];
+} cpu_counters_t;
+
+/** Contadores de cada CPU; sólo los escribe el hilo receptor */
+static cpu_counters_t cpu_counters[PLATFORM_MAX_CPUS];
+
+/** Veces que el kernel informó que el socket se desbordó (ENOBUFS) */
+static _Atomic uint64_t overruns;
+
+/** Socket del conector de procesos; -1 si no está abierto */
+static int netlink_fd = -1;
+
+/** eventfd para despertar al hilo receptor al cerrar */
+static int wake_fd = -1;
+
+/** Hilo receptor */
+static pthread_t receiver;
+
+/** Indica si la suscripción está activa */
+static bool opened;
+
+/** Eventos recientes, protegidos por ring_lock */
+static proc_event_t ring[CONFIG_MAX_PROC_EVENTS_RING];
+
+/** Posición del próximo evento y cantidad de eventos guardados */
+static int ring_head, ring_count;
+
+/** Capacidad vigente; se lee sin lock para no tomarlo cuando el anillo está deshabilitado */
+static atomic_int ring_capacity;
+
+/** Protege el anillo entre el hilo receptor y los pedidos HTTP */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Nombre de cada evento en /proc_events */
+static const char* const kind_names[PROC_EVENT_KIND_COUNT] = {
+    [PROC_EVENT_KIND_FORK] = "fork",
+    [PROC_EVENT_KIND_EXEC] = "exec",
+    [PROC_EVENT_KIND_EXIT] = "exit",
+};
+
+/**
+ * @brief Envía PROC_CN_MCAST_LISTEN o PROC_CN_MCAST_IGNORE al conector.
+ */
+static int send_mcast_op(int fd, enum proc_cn_mcast_op op)
+{
+    _Alignas(struct nlmsghdr) char buffer[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+    memset(buffer, 0, sizeof(buffer));
+
+    struct nlmsghdr* header = (struct nlmsghdr*)buffer;
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = 0;
+
+    struct cn_msg* message = NLMSG_DATA(header);
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(op);
+    memcpy(message->data, &op, sizeof(op));
+
+    return send(fd, buffer, header->nlmsg_len, 0) == (ssize_t)header->nlmsg_len ? 0 : -1;
+}
+
+/**
+ * @brief Suma un evento a los contadores de una CPU.
+ *
+ * Hay un único escritor, de modo que basta una carga y un almacenamiento atómicos, sin
+ * la instrucción con lock de un incremento atómico. Los eventos de CPUs no monitoreadas se
+ * descartan (ver platform.h).
+ */
+static void count_event(int cpu, proc_event_kind_t kind)
+{
+    if (cpu < 0 || cpu >= PLATFORM_MAX_CPUS)
+    {
+        return;
+    }
+
+    _Atomic uint64_t* counter = &cpu_counters[cpu].counts[kind];
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Guarda un evento en el anillo si está habilitado.
+ */
+static void record_event(const proc_event_t* event)
+{
+    if (atomic_load_explicit(&ring_capacity, memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    int capacity = atomic_load_explicit(&ring_capacity, memory_order_relaxed);
+    if (capacity > 0)
+    {
+        ring[ring_head] = *event;
+        ring_head = (ring_head + 1) % capacity;
+        if (ring_count < capacity)
+        {
+            ring_count++;
+        }
+    }
+    pthread_mutex_unlock(&ring_lock);
+}
+
+/**
+ * @brief Cuenta un evento del conector y lo guarda en el anillo.
+ *
+ * Los fork y exit de hilos se descartan: sólo interesan los procesos (pid == tgid).
+ */
+static void handle_event(const struct proc_event* raw)
+{
+    proc_event_t event = {.timestamp_ns = raw->timestamp_ns, .cpu = (int)raw->cpu};
+
+    switch (raw->what)
+    {
+    case PROC_EVENT_FORK:
+        if (raw->event_data.fork.child_pid != raw->event_data.fork.child_tgid)
+        {
+            return;
+        }
+        event.kind = PROC_EVENT_KIND_FORK;
+        event.pid = raw->event_data.fork.child_tgid;
+        event.parent_pid = raw->event_data.fork.parent_tgid;
+        break;
+    case PROC_EVENT_EXEC:
+        event.kind = PROC_EVENT_KIND_EXEC;
+        event.pid = raw->event_data.exec.process_tgid;
+        break;
+    case PROC_EVENT_EXIT:
+        if (raw->event_data.exit.process_pid != raw->event_data.exit.process_tgid)
+        {
+            return;
+        }
+        event.kind = PROC_EVENT_KIND_EXIT;
+        event.pid = raw->event_data.exit.process_tgid;
+        event.exit_code = raw->event_data.exit.exit_code;
+        if (WIFSIGNALED(event.exit_code))
+        {
+            count_event(event.cpu, PROC_EVENT_KIND_SIGNALED);
+        }
+        else if (WEXITSTATUS(event.exit_code) != 0)
+        {
+            count_event(event.cpu, PROC_EVENT_KIND_FAILED);
+        }
+        break;
+    default:
+        return; // PROC_EVENT_NONE (confirmación de la suscripción), uid, sid, ptrace, etc.
+    }
+
+    count_event(event.cpu, event.kind);
+    record_event(&event);
+}
+
+/**
+ * @brief Función del hilo receptor: procesa los mensajes hasta que se escribe en wake_fd.
+ */
+static void* receive_events(void* arg)
+{
+    (void)arg; // Unused argument
+
+    _Alignas(struct nlmsghdr) char buffer[RECEIVE_BUFFER_SIZE];
+    struct pollfd fds[2] = {{.fd = netlink_fd, .events = POLLIN}, {.fd = wake_fd, .events = POLLIN}};
+
+    while (1)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Error waiting for process events");
+            break;
+        }
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+
+        ssize_t length = recv(netlink_fd, buffer, sizeof(buffer), 0);
+        if (length < 0)
+        {
+            if (errno == ENOBUFS)
+            {
+                atomic_fetch_add_explicit(&overruns, 1, memory_order_relaxed); // El socket sigue siendo válido
+            }
+            else if (errno != EINTR && errno != EAGAIN)
+            {
+                perror("Error receiving process events");
+                break;
+            }
+            continue;
+        }
+
+        for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, (size_t)length);
+             header = NLMSG_NEXT(header, length))
+        {
+            if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP)
+            {
+                continue;
+            }
+
+            const struct cn_msg* message = NLMSG_DATA(header);
+            if (message->id.idx == CN_IDX_PROC && message->id.val == CN_VAL_PROC &&
+                message->len >= sizeof(struct proc_event))
+            {
+                handle_event((const struct proc_event*)message->data);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Espera la confirmación de PROC_CN_MCAST_LISTEN.
+ *
+ * El kernel exige CAP_NET_ADMIN en el espacio de nombres de usuario inicial para suscribirse,
+ * aunque el bind() haya funcionado (por ejemplo, dentro de un contenedor). Si lo rechaza
+ * responde con un error o, si no hay otros suscriptores, no responde; en ambos casos el
+ * socket nunca recibiría eventos y los contadores quedarían en cero.
+ *
+ * @return 0 si la suscripción se confirmó, o -1 en caso contrario (errno indica el motivo).
+ */
+static int wait_listen_ack(int fd)
+{
+    _Alignas(struct nlmsghdr) char buffer[RECEIVE_BUFFER_SIZE];
+    int64_t deadline = platform_now_ns() + (int64_t)ACK_TIMEOUT_MS * 1000000;
+    struct pollfd poll_fd = {.fd = fd, .events = POLLIN};
+
+    while (1)
+    {
+        int remaining_ms = (int)((deadline - platform_now_ns()) / 1000000);
+        if (remaining_ms <= 0 || poll(&poll_fd, 1, remaining_ms) == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        ssize_t length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (length < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // Los eventos de otros suscriptores pueden llegar antes; sólo interesa la confirmación
+        for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, (size_t)length);
+             header = NLMSG_NEXT(header, length))
+        {
+            const struct cn_msg* message = NLMSG_DATA(header);
+            if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP ||
+                message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC ||
+                message->len < sizeof(struct proc_event))
+            {
+                continue;
+            }
+
+            const struct proc_event* event = (const struct proc_event*)message->data;
+            if (event->what == PROC_EVENT_NONE)
+            {
+                errno = (int)event->event_data.ack.err;
+                return errno == 0 ? 0 : -1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Cierra el socket y el eventfd, incluso los de una apertura fallida.
+ */
+static void close_descriptors()
+{
+    if (netlink_fd >= 0)
+    {
+        close(netlink_fd);
+        netlink_fd = -1;
+    }
+    if (wake_fd >= 0)
+    {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+int proc_events_open()
+{
+    if (opened)
+    {
+        return 0;
+    }
+
+    netlink_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (netlink_fd < 0)
+    {
+        perror("Error opening the netlink proc connector");
+        return -1;
+    }
+
+    // Un buffer más grande que rmem_max sólo se consigue con SO_RCVBUFFORCE (CAP_NET_ADMIN)
+    int socket_buffer = SOCKET_BUFFER_SIZE;
+    if (setsockopt(netlink_fd, SOL_SOCKET, SO_RCVBUFFORCE, &socket_buffer, sizeof(socket_buffer)) != 0)
+    {
+        setsockopt(netlink_fd, SOL_SOCKET, SO_RCVBUF, &socket_buffer, sizeof(socket_buffer));
+    }
+
+    struct sockaddr_nl address = {.nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC, .nl_pid = 0};
+    if (bind(netlink_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        send_mcast_op(netlink_fd, PROC_CN_MCAST_LISTEN) != 0 || wait_listen_ack(netlink_fd) != 0)
+    {
+        if (errno == EPERM || errno == EACCES || errno == ETIMEDOUT)
+        {
+            fprintf(stderr, "The netlink proc connector did not accept the subscription (%s); it requires "
+                            "CAP_NET_ADMIN in the initial user namespace, process events disabled\n",
+                    strerror(errno));
+        }
+        else
+        {
+            perror("Error subscribing to process events");
+        }
+        close_descriptors();
+        return -1;
+    }
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0)
+    {
+        perror("eventfd");
+        close_descriptors();
+        return -1;
+    }
+
+    for (int cpu = 0; cpu < PLATFORM_MAX_CPUS; cpu++)
+    {
+        for (int kind = 0; kind < PROC_EVENT_KIND_COUNT; kind++)
+        {
+            atomic_store_explicit(&cpu_counters[cpu].counts[kind], 0, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&overruns, 0, memory_order_relaxed);
+    pthread_mutex_lock(&ring_lock);
+    ring_head = 0;
+    ring_count = 0;
+    pthread_mutex_unlock(&ring_lock);
+
+    if (pthread_create(&receiver, NULL, receive_events, NULL) != 0)
+    {
+        fprintf(stderr, "Error creating the process events thread\n");
+        send_mcast_op(netlink_fd, PROC_CN_MCAST_IGNORE);
+        close_descriptors();
+        return -1;
+    }
+
+    opened = true;
+    return 0;
+}
+
+void proc_events_close()
+{
+    if (!opened)
+    {
+        return;
+    }
+
+    uint64_t wake = 1;
+    if (write(wake_fd, &wake, sizeof(wake)) == (ssize_t)sizeof(wake))
+    {
+        pthread_join(receiver, NULL);
+    }
+    else
+    {
+        pthread_cancel(receiver); // poll() es un punto de cancelación
+        pthread_join(receiver, NULL);
+    }
+
+    send_mcast_op(netlink_fd, PROC_CN_MCAST_IGNORE);
+    close_descriptors();
+    opened = false;
+}
+
+bool proc_events_available()
+{
+    return opened;
+}
+
+int proc_events_read(uint64_t counts[PLATFORM_MAX_CPUS][PROC_EVENT_KIND_COUNT], uint64_t* overrun_count)
+{
+    if (!opened)
+    {
+        return -1;
+    }
+
+    int cpus = platform_cpu_count();
+    for (int cpu = 0; cpu < cpus; cpu++)
+    {
+        for (int kind = 0; kind < PROC_EVENT_KIND_COUNT; kind++)
+        {
+            counts[cpu][kind] = atomic_load_explicit(&cpu_counters[cpu].counts[kind], memory_order_relaxed);
+        }
+    }
+    *overrun_count = atomic_load_explicit(&overruns, memory_order_relaxed);
+
+    return 0;
+}
+
+void proc_events_set_ring(int capacity)
+{
+    if (capacity < 0)
+    {
+        capacity = 0;
+    }
+    if (capacity > CONFIG_MAX_PROC_EVENTS_RING)
+    {
+        capacity = CONFIG_MAX_PROC_EVENTS_RING;
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    if (atomic_load_explicit(&ring_capacity, memory_order_relaxed) != capacity)
+    {
+        ring_head = 0;
+        ring_count = 0;
+        atomic_store_explicit(&ring_capacity, capacity, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&ring_lock);
+}
+
+int proc_events_ring_capacity()
+{
+    return atomic_load_explicit(&ring_capacity, memory_order_relaxed);
+}
+
+size_t proc_events_render_ring(char* out, size_t cap)
+{
+    size_t length = 0;
+
+    pthread_mutex_lock(&ring_lock);
+    int capacity = atomic_load_explicit(&ring_capacity, memory_order_relaxed);
+    int start = ring_count < capacity ? 0 : ring_head; // El más antiguo
+    for (int i = 0; i < ring_count; i++)
+    {
+        const proc_event_t* event = &ring[(start + i) % capacity];
+        char line[PROC_EVENTS_LINE_SIZE];
+        int written = snprintf(line, sizeof(line), "%llu %s pid=%d ppid=%d cpu=%d code=%u\n",
+                               (unsigned long long)event->timestamp_ns, kind_names[event->kind], (int)event->pid,
+                               (int)event->parent_pid, event->cpu, event->exit_code);
+        if (written < 0 || (size_t)written >= sizeof(line) || length + (size_t)written > cap)
+        {
+            break;
+        }
+        memcpy(out + length, line, (size_t)written);
+        length += (size_t)written;
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    return length;
+}
@@ -0,0 +1,689 @@
+#include "../include/registry.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Sufijo de las muestras de un contador en todos los formatos */
+#define COUNTER_SUFFIX "_total"
+
+/** Longitud máxima de un valor formateado con "%.17g" */
+#define VALUE_TEXT_SIZE 32
+
+/** Bytes máximos de un tag más una longitud o un varint en protobuf */
+#define PB_FIELD_OVERHEAD 11
+
+/** Bytes máximos de un campo double en protobuf (tag más 8 bytes) */
+#define PB_DOUBLE_SIZE 9
+
+/** Bytes máximos de un google.protobuf.Timestamp anidado */
+#define PB_TIMESTAMP_SIZE (PB_FIELD_OVERHEAD + 2 * PB_FIELD_OVERHEAD)
+
+/** Bytes máximos de las etiquetas de una serie en protobuf: cada par ocupa al menos 4 caracteres
+ * (a="") y suma tres campos cuya longitud, menor que SERIES_LABELS_SIZE, cabe en un byte */
+#define PB_LABELS_SIZE (SERIES_LABELS_SIZE + (SERIES_LABELS_SIZE / 4 + 1) * 3 * 2)
+
+_Static_assert(SERIES_LABELS_SIZE < 128, "las longitudes de las etiquetas deben caber en un varint de un byte");
+
+/** Tipos de cable de protobuf */
+enum
+{
+    WIRE_VARINT = 0,
+    WIRE_FIXED64 = 1,
+    WIRE_LENGTH = 2
+};
+
+/** Familia de métricas: metadatos y rango de series que le pertenecen */
+typedef struct
+{
+    const char* name;
+    const char* help;
+    metric_type_t type;
+    metric_group_t group;
+    size_t first_series;
+    size_t series_count;
+    size_t active_count; // Series que se exponen, las primeras de la familia
+} metric_family_t;
+
+/** Serie de una familia: etiquetas, sufijo del nombre, último valor, creación y exemplar */
+typedef struct
+{
+    char labels[SERIES_LABELS_SIZE];
+    const char* suffix;
+    double value;
+    double created;
+    bool has_exemplar;
+    char exemplar_labels[SERIES_LABELS_SIZE];
+    double exemplar_value;
+    double exemplar_timestamp;
+} metric_series_t;
+
+/** Familias registradas */
+static metric_family_t families[REGISTRY_MAX_FAMILIES];
+
+/** Series de todas las familias, contiguas por familia */
+static metric_series_t series[REGISTRY_MAX_SERIES];
+
+/** Cantidad de familias registradas */
+static size_t family_count;
+
+/** Cantidad de series asignadas */
+static size_t series_used;
+
+/** Grupos cuyas familias se exponen; METRIC_GROUP_ALWAYS queda siempre habilitado */
+static bool group_enabled[METRIC_GROUP_COUNT + 1] = {[METRIC_GROUP_ALWAYS] = true};
+
+/** Nombres de los tipos en los formatos de texto */
+static const char* const type_names[] = {
+    [METRIC_TYPE_GAUGE] = "gauge",
+    [METRIC_TYPE_COUNTER] = "counter",
+    [METRIC_TYPE_SUMMARY] = "summary",
+};
+
+/** Valores del enum io.prometheus.client.MetricType */
+static const unsigned proto_types[] = {
+    [METRIC_TYPE_GAUGE] = 1,
+    [METRIC_TYPE_COUNTER] = 0,
+    [METRIC_TYPE_SUMMARY] = 2,
+};
+
+/** Destino de la serialización; con data en NULL sólo mide */
+typedef struct
+{
+    char* data;
+    size_t capacity;
+    size_t length; // Bytes escritos, o que se habrían escrito si no alcanza la capacidad
+} writer_t;
+
+/** Etiqueta dentro de un conjunto ya formateado; el valor conserva sus escapes */
+typedef struct
+{
+    const char* name;
+    size_t name_length;
+    const char* value;
+    size_t value_length;
+} label_t;
+
+/** Serie de una familia, para codificarla como io.prometheus.client.Metric */
+typedef struct
+{
+    const metric_family_t* family;
+    const metric_series_t* entry;
+} series_ref_t;
+
+/** Cuantil de un summary, para codificarlo como io.prometheus.client.Quantile */
+typedef struct
+{
+    double quantile;
+    double value;
+} quantile_t;
+
+/** Codificador de un mensaje protobuf anidado */
+typedef void (*encode_fn)(writer_t* w, const void* message);
+
+int registry_add_family(const char* name, const char* help, metric_type_t type, metric_group_t group,
+                        size_t series_count)
+{
+    if (family_count == REGISTRY_MAX_FAMILIES || series_count > REGISTRY_MAX_SERIES - series_used)
+    {
+        fprintf(stderr, "Registry full, cannot add metric %s\n", name);
+        return -1;
+    }
+
+    metric_family_t* family = &families[family_count];
+    family->name = name;
+    family->help = help;
+    family->type = type;
+    family->group = group;
+    family->first_series = series_used;
+    family->series_count = series_count;
+    family->active_count = series_count;
+    for (size_t i = 0; i < series_count; i++)
+    {
+        series[series_used + i].suffix = "";
+    }
+    series_used += series_count;
+
+    return (int)family_count++;
+}
+
+void registry_set_labels(int family, size_t index, const char* labels)
+{
+    metric_series_t* entry = &series[families[family].first_series + index];
+    snprintf(entry->labels, sizeof(entry->labels), "%s", labels);
+}
+
+void registry_set_suffix(int family, size_t index, const char* suffix)
+{
+    series[families[family].first_series + index].suffix = suffix;
+}
+
+void registry_set(int family, size_t index, double value)
+{
+    series[families[family].first_series + index].value = value;
+}
+
+void registry_set_created(int family, size_t index, double seconds)
+{
+    series[families[family].first_series + index].created = seconds;
+}
+
+void registry_set_exemplar(int family, size_t index, const char* labels, double value, double timestamp)
+{
+    metric_series_t* entry = &series[families[family].first_series + index];
+    snprintf(entry->exemplar_labels, sizeof(entry->exemplar_labels), "%s", labels);
+    entry->exemplar_value = value;
+    entry->exemplar_timestamp = timestamp;
+    entry->has_exemplar = true;
+}
+
+void registry_set_active_series(int family, size_t count)
+{
+    families[family].active_count = count < families[family].series_count ? count : families[family].series_count;
+}
+
+void registry_enable_group(metric_group_t group, bool enabled)
+{
+    group_enabled[group] = enabled;
+}
+
+
+/**
+ * @brief Agrega @p n bytes al destino, si entran.
+ */
+static void put(writer_t* w, const void* bytes, size_t n)
+{
+    if (w->data != NULL && w->length <= w->capacity && n <= w->capacity - w->length)
+    {
+        memcpy(w->data + w->length, bytes, n);
+    }
+    w->length += n;
+}
+
+/**
+ * @brief Agrega texto con formato al destino, si entra (incluyendo el '\0' final).
+ */
+static void put_format(writer_t* w, const char* format, ...)
+{
+    bool room = w->data != NULL && w->length < w->capacity;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(room ? w->data + w->length : NULL, room ? w->capacity - w->length : 0, format, args);
+    va_end(args);
+
+    if (written > 0)
+    {
+        w->length += written;
+    }
+}
+
+/**
+ * @brief Agrega un valor en los formatos de texto, con NaN e infinitos como los espera OpenMetrics.
+ */
+static void put_value(writer_t* w, double value)
+{
+    if (isnan(value))
+    {
+        put_format(w, "NaN");
+    }
+    else if (isinf(value))
+    {
+        put_format(w, value > 0 ? "+Inf" : "-Inf");
+    }
+    else
+    {
+        put_format(w, "%.17g", value);
+    }
+}
+
+/**
+ * @brief Agrega el nombre y las etiquetas de una muestra, sin su valor.
+ */
+static void put_sample_name(writer_t* w, const char* name, const char* suffix, const char* labels)
+{
+    if (labels[0] != '\0')
+    {
+        put_format(w, "%s%s{%s} ", name, suffix, labels);
+    }
+    else
+    {
+        put_format(w, "%s%s ", name, suffix);
+    }
+}
+
+/**
+ * @brief Serializa una familia en el formato de texto de Prometheus.
+ *
+ * Como en OpenMetrics, las muestras de los contadores llevan el sufijo _total; en este formato
+ * la familia se nombra igual que sus muestras.
+ */
+static void render_text_family(writer_t* w, const metric_family_t* family)
+{
+    const char* suffix = family->type == METRIC_TYPE_COUNTER ? COUNTER_SUFFIX : "";
+
+    put_format(w, "# HELP %s%s %s\n# TYPE %s%s %s\n", family->name, suffix, family->help, family->name, suffix,
+               type_names[family->type]);
+
+    for (size_t j = 0; j < family->active_count; j++)
+    {
+        const metric_series_t* entry = &series[family->first_series + j];
+        put_sample_name(w, family->name, family->type == METRIC_TYPE_COUNTER ? COUNTER_SUFFIX : entry->suffix,
+                        entry->labels);
+        put_value(w, entry->value);
+        put(w, "\n", 1);
+    }
+}
+
+/**
+ * @brief Serializa una familia en OpenMetrics.
+ *
+ * Los contadores llevan el sufijo _total, su exemplar y una serie _created; los summaries,
+ * una serie _created con el instante de creación de su primera serie.
+ */
+static void render_openmetrics_family(writer_t* w, const metric_family_t* family)
+{
+    bool counter = family->type == METRIC_TYPE_COUNTER;
+
+    put_format(w, "# HELP %s %s\n# TYPE %s %s\n", family->name, family->help, family->name, type_names[family->type]);
+
+    for (size_t j = 0; j < family->active_count; j++)
+    {
+        const metric_series_t* entry = &series[family->first_series + j];
+        put_sample_name(w, family->name, counter ? COUNTER_SUFFIX : entry->suffix, entry->labels);
+        put_value(w, entry->value);
+        if (counter && entry->has_exemplar)
+        {
+            put_format(w, " # {%s} ", entry->exemplar_labels);
+            put_value(w, entry->exemplar_value);
+            put_format(w, " %.3f", entry->exemplar_timestamp);
+        }
+        put(w, "\n", 1);
+
+        if (counter && entry->created > 0)
+        {
+            put_sample_name(w, family->name, "_created", entry->labels);
+            put_format(w, "%.3f\n", entry->created);
+        }
+    }
+
+    const metric_series_t* first = &series[family->first_series];
+    if (family->type == METRIC_TYPE_SUMMARY && first->created > 0)
+    {
+        put_format(w, "%s_created %.3f\n", family->name, first->created);
+    }
+}
+
+/**
+ * @brief Agrega un varint de protobuf.
+ */
+static void put_varint(writer_t* w, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t n = 0;
+
+    do
+    {
+        bytes[n++] = (unsigned char)((value & 0x7f) | (value > 0x7f ? 0x80 : 0));
+        value >>= 7;
+    } while (value != 0);
+
+    put(w, bytes, n);
+}
+
+/**
+ * @brief Agrega la clave de un campo de protobuf.
+ */
+static void put_tag(writer_t* w, unsigned field, unsigned wire_type)
+{
+    put_varint(w, field << 3 | wire_type);
+}
+
+/**
+ * @brief Agrega un campo varint de protobuf.
+ */
+static void put_varint_field(writer_t* w, unsigned field, uint64_t value)
+{
+    put_tag(w, field, WIRE_VARINT);
+    put_varint(w, value);
+}
+
+/**
+ * @brief Agrega un campo double de protobuf, en little-endian sin importar el host.
+ */
+static void put_double_field(writer_t* w, unsigned field, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        bytes[i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    put_tag(w, field, WIRE_FIXED64);
+    put(w, bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Agrega un campo string de protobuf.
+ */
+static void put_bytes_field(writer_t* w, unsigned field, const char* data, size_t length)
+{
+    put_tag(w, field, WIRE_LENGTH);
+    put_varint(w, length);
+    put(w, data, length);
+}
+
+/**
+ * @brief Agrega un campo de texto formado por @p name seguido de @p suffix.
+ */
+static void put_name_field(writer_t* w, unsigned field, const char* name, const char* suffix)
+{
+    size_t name_length = strlen(name), suffix_length = strlen(suffix);
+
+    put_tag(w, field, WIRE_LENGTH);
+    put_varint(w, name_length + suffix_length);
+    put(w, name, name_length);
+    put(w, suffix, suffix_length);
+}
+
+/**
+ * @brief Agrega un mensaje anidado, midiéndolo primero para escribir su longitud.
+ */
+static void put_message_field(writer_t* w, unsigned field, encode_fn encode, const void* message)
+{
+    writer_t sizer = {0};
+    encode(&sizer, message);
+
+    put_tag(w, field, WIRE_LENGTH);
+    put_varint(w, sizer.length);
+    encode(w, message);
+}
+
+/**
+ * @brief Agrega el valor de una etiqueta sin los escapes del formato de texto.
+ */
+static void put_unescaped(writer_t* w, const char* value, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = value[i];
+        if (c == '\\' && i + 1 < length)
+        {
+            c = value[++i] == 'n' ? '\n' : value[i];
+        }
+        put(w, &c, 1);
+    }
+}
+
+/**
+ * @brief Lee la próxima etiqueta de un conjunto ya formateado (`a="x",b="y"`).
+ *
+ * @return false al llegar al final o si el formato no es válido.
+ */
+static bool next_label(const char** cursor, label_t* label)
+{
+    const char* start = *cursor;
+    while (*start == ',' || *start == ' ')
+    {
+        start++;
+    }
+
+    const char* equals = strchr(start, '=');
+    if (*start == '\0' || equals == NULL || equals[1] != '"')
+    {
+        return false;
+    }
+
+    const char* end = equals + 2;
+    while (*end != '\0' && *end != '"')
+    {
+        end += end[0] == '\\' && end[1] != '\0' ? 2 : 1;
+    }
+
+    label->name = start;
+    label->name_length = equals - start;
+    label->value = equals + 2;
+    label->value_length = end - label->value;
+    *cursor = *end == '"' ? end + 1 : end;
+
+    return true;
+}
+
+/** Codifica un io.prometheus.client.LabelPair */
+static void encode_label_pair(writer_t* w, const void* message)
+{
+    const label_t* label = message;
+    writer_t sizer = {0};
+    put_unescaped(&sizer, label->value, label->value_length);
+
+    put_bytes_field(w, 1, label->name, label->name_length);
+    put_tag(w, 2, WIRE_LENGTH);
+    put_varint(w, sizer.length);
+    put_unescaped(w, label->value, label->value_length);
+}
+
+/**
+ * @brief Agrega un LabelPair por cada etiqueta de un conjunto ya formateado.
+ */
+static void put_labels(writer_t* w, unsigned field, const char* labels)
+{
+    label_t label;
+    while (next_label(&labels, &label))
+    {
+        put_message_field(w, field, encode_label_pair, &label);
+    }
+}
+
+/** Codifica un google.protobuf.Timestamp a partir de segundos desde la época Unix */
+static void encode_timestamp(writer_t* w, const void* message)
+{
+    double seconds = *(const double*)message;
+    double whole = floor(seconds);
+    int64_t nanos = (int64_t)((seconds - whole) * 1e9);
+
+    if (whole != 0)
+    {
+        put_varint_field(w, 1, (uint64_t)(int64_t)whole);
+    }
+    if (nanos != 0)
+    {
+        put_varint_field(w, 2, (uint64_t)nanos);
+    }
+}
+
+/** Codifica un io.prometheus.client.Exemplar */
+static void encode_exemplar(writer_t* w, const void* message)
+{
+    const metric_series_t* entry = message;
+
+    put_labels(w, 1, entry->exemplar_labels);
+    put_double_field(w, 2, entry->exemplar_value);
+    put_message_field(w, 3, encode_timestamp, &entry->exemplar_timestamp);
+}
+
+/** Codifica un io.prometheus.client.Gauge */
+static void encode_gauge(writer_t* w, const void* message)
+{
+    put_double_field(w, 1, ((const metric_series_t*)message)->value);
+}
+
+/** Codifica un io.prometheus.client.Counter */
+static void encode_counter(writer_t* w, const void* message)
+{
+    const metric_series_t* entry = message;
+
+    put_double_field(w, 1, entry->value);
+    if (entry->has_exemplar)
+    {
+        put_message_field(w, 2, encode_exemplar, entry);
+    }
+    if (entry->created > 0)
+    {
+        put_message_field(w, 3, encode_timestamp, &entry->created);
+    }
+}
+
+/** Codifica un io.prometheus.client.Metric con una serie de un gauge o un contador */
+static void encode_metric(writer_t* w, const void* message)
+{
+    const series_ref_t* ref = message;
+
+    put_labels(w, 1, ref->entry->labels);
+    if (ref->family->type == METRIC_TYPE_COUNTER)
+    {
+        put_message_field(w, 3, encode_counter, ref->entry);
+    }
+    else
+    {
+        put_message_field(w, 2, encode_gauge, ref->entry);
+    }
+}
+
+/** Codifica un io.prometheus.client.Quantile */
+static void encode_quantile(writer_t* w, const void* message)
+{
+    const quantile_t* quantile = message;
+
+    put_double_field(w, 1, quantile->quantile);
+    put_double_field(w, 2, quantile->value);
+}
+
+/** Codifica un io.prometheus.client.Summary a partir de todas las series de la familia */
+static void encode_summary(writer_t* w, const void* message)
+{
+    const metric_family_t* family = message;
+
+    for (size_t j = 0; j < family->active_count; j++)
+    {
+        const metric_series_t* entry = &series[family->first_series + j];
+        if (strcmp(entry->suffix, "_count") == 0)
+        {
+            put_varint_field(w, 1, entry->value > 0 ? (uint64_t)entry->value : 0);
+        }
+        else if (strcmp(entry->suffix, "_sum") == 0)
+        {
+            put_double_field(w, 2, entry->value);
+        }
+        else
+        {
+            const char* labels = entry->labels;
+            label_t label;
+            while (next_label(&labels, &label))
+            {
+                if (label.name_length == strlen("quantile") && strncmp(label.name, "quantile", label.name_length) == 0)
+                {
+                    quantile_t quantile = {strtod(label.value, NULL), entry->value};
+                    put_message_field(w, 3, encode_quantile, &quantile);
+                }
+            }
+        }
+    }
+
+    const metric_series_t* first = &series[family->first_series];
+    if (first->created > 0)
+    {
+        put_message_field(w, 4, encode_timestamp, &first->created);
+    }
+}
+
+/** Codifica un io.prometheus.client.Metric con el summary de una familia */
+static void encode_summary_metric(writer_t* w, const void* message)
+{
+    put_message_field(w, 4, encode_summary, message);
+}
+
+/** Codifica un io.prometheus.client.MetricFamily; los contadores se nombran como sus muestras de texto */
+static void encode_family(writer_t* w, const void* message)
+{
+    const metric_family_t* family = message;
+
+    put_name_field(w, 1, family->name, family->type == METRIC_TYPE_COUNTER ? COUNTER_SUFFIX : "");
+    put_bytes_field(w, 2, family->help, strlen(family->help));
+    put_varint_field(w, 3, proto_types[family->type]);
+
+    if (family->type == METRIC_TYPE_SUMMARY)
+    {
+        put_message_field(w, 4, encode_summary_metric, family);
+        return;
+    }
+    for (size_t j = 0; j < family->active_count; j++)
+    {
+        series_ref_t ref = {family, &series[family->first_series + j]};
+        put_message_field(w, 4, encode_metric, &ref);
+    }
+}
+
+/**
+ * @brief Serializa una familia como un MetricFamily precedido por su longitud.
+ */
+static void render_protobuf_family(writer_t* w, const metric_family_t* family)
+{
+    writer_t sizer = {0};
+    encode_family(&sizer, family);
+
+    put_varint(w, sizer.length);
+    encode_family(w, family);
+}
+
+size_t registry_render_bound()
+{
+    size_t bound = sizeof("# EOF\n");
+
+    for (size_t i = 0; i < family_count; i++)
+    {
+        const metric_family_t* family = &families[i];
+        size_t name_length = strlen(family->name) + strlen(COUNTER_SUFFIX);
+        size_t help_length = strlen(family->help);
+
+        size_t text_header = sizeof("# HELP  \n") + sizeof("# TYPE  \n") + 2 * name_length + help_length +
+                             strlen(type_names[family->type]);
+        size_t pb_header = 3 * PB_FIELD_OVERHEAD + name_length + help_length;
+
+        // Muestra, serie _created y exemplar de una serie en OpenMetrics (la cota del texto queda incluida)
+        size_t text_series = 2 * (name_length + SERIES_SUFFIX_MAX + sizeof("{} \n") + SERIES_LABELS_SIZE) +
+                             sizeof(" # {} ") + SERIES_LABELS_SIZE + 4 * VALUE_TEXT_SIZE;
+        size_t pb_series = 4 * PB_FIELD_OVERHEAD + 2 * PB_LABELS_SIZE + 3 * PB_DOUBLE_SIZE + 2 * PB_TIMESTAMP_SIZE;
+
+        bound += (text_header > pb_header ? text_header : pb_header) +
+                 family->series_count * (text_series > pb_series ? text_series : pb_series);
+    }
+
+    return bound;
+}
+
+size_t registry_render(char* out, size_t capacity, registry_format_t format)
+{
+    writer_t w = {out, capacity, 0};
+
+    for (size_t i = 0; i < family_count; i++)
+    {
+        const metric_family_t* family = &families[i];
+        if (!group_enabled[family->group])
+        {
+            continue;
+        }
+
+        switch (format)
+        {
+        case REGISTRY_FORMAT_OPENMETRICS:
+            render_openmetrics_family(&w, family);
+            break;
+        case REGISTRY_FORMAT_PROTOBUF:
+            render_protobuf_family(&w, family);
+            break;
+        default:
+            render_text_family(&w, family);
+            break;
+        }
+    }
+    if (format == REGISTRY_FORMAT_OPENMETRICS)
+    {
+        put_format(&w, "# EOF\n");
+    }
+
+    return w.length < capacity ? w.length : 0;
+}
@@ -0,0 +1,404 @@
+#include "../include/sampler.h"
+#include "../include/config.h"
+#include "../include/metrics.h"
+#include "../include/platform.h"
+#include "../include/registry.h"
+#include "../include/stats.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Series con estadísticas en flujo */
+enum stream_series
+{
+    STREAM_CPU,
+    STREAM_MEMORY,
+    STREAM_PRESSURE_CPU_SOME,
+    STREAM_PRESSURE_CPU_FULL,
+    STREAM_PRESSURE_IO_SOME,
+    STREAM_PRESSURE_IO_FULL,
+    STREAM_PRESSURE_MEMORY_SOME,
+    STREAM_PRESSURE_MEMORY_FULL,
+    STREAM_SERIES_COUNT
+};
+
+/** Recursos de /proc/pressure; sus series "some" y "full" siguen este orden desde STREAM_PRESSURE_CPU_SOME */
+static const char* const pressure_resources[] = {"cpu", "io", "memory"};
+
+/** Cantidad de recursos de /proc/pressure */
+#define PRESSURE_RESOURCE_COUNT (sizeof(pressure_resources) / sizeof(pressure_resources[0]))
+
+/** Familias exportadas por cada serie */
+enum stream_family
+{
+    FAMILY_EWMA,
+    FAMILY_MIN,
+    FAMILY_MAX,
+    FAMILY_WINDOW,
+    FAMILY_WINDOW_SUM,
+    FAMILY_WINDOW_SAMPLES,
+    FAMILY_COUNT
+};
+
+/** Nombre y ayuda de cada familia, indexados por serie y familia */
+static const char* const family_defs[STREAM_SERIES_COUNT][FAMILY_COUNT][2] = {
+    [STREAM_CPU] =
+        {
+            {"cpu_usage_percentage_ewma", "Exponentially weighted moving average of the CPU usage percentage"},
+            {"cpu_usage_percentage_window_min", "Minimum CPU usage percentage sampled in the stats window"},
+            {"cpu_usage_percentage_window_max", "Maximum CPU usage percentage sampled in the stats window"},
+            {"cpu_usage_percentage_window",
+             "CPU usage percentage sampled since startup, quantiles over the stats window"},
+            {"cpu_usage_percentage_window_sample_sum", "Sum of the CPU usage percentages sampled in the stats window"},
+            {"cpu_usage_percentage_window_samples", "CPU usage samples in the stats window"},
+        },
+    [STREAM_MEMORY] =
+        {
+            {"memory_usage_percentage_ewma", "Exponentially weighted moving average of the memory usage percentage"},
+            {"memory_usage_percentage_window_min", "Minimum memory usage percentage sampled in the stats window"},
+            {"memory_usage_percentage_window_max", "Maximum memory usage percentage sampled in the stats window"},
+            {"memory_usage_percentage_window",
+             "Memory usage percentage sampled since startup, quantiles over the stats window"},
+            {"memory_usage_percentage_window_sample_sum",
+             "Sum of the memory usage percentages sampled in the stats window"},
+            {"memory_usage_percentage_window_samples", "Memory usage samples in the stats window"},
+        },
+    [STREAM_PRESSURE_CPU_SOME] =
+        {
+            {"pressure_cpu_some_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time some tasks were stalled on CPU"},
+            {"pressure_cpu_some_percentage_window_min",
+             "Minimum percentage of time some tasks were stalled on CPU sampled in the stats window"},
+            {"pressure_cpu_some_percentage_window_max",
+             "Maximum percentage of time some tasks were stalled on CPU sampled in the stats window"},
+            {"pressure_cpu_some_percentage_window",
+             "Percentage of time some tasks were stalled on CPU sampled since startup, quantiles over the stats "
+             "window"},
+            {"pressure_cpu_some_percentage_window_sample_sum",
+             "Sum of the CPU some pressure percentages sampled in the stats window"},
+            {"pressure_cpu_some_percentage_window_samples", "CPU some pressure samples in the stats window"},
+        },
+    [STREAM_PRESSURE_CPU_FULL] =
+        {
+            {"pressure_cpu_full_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time all non-idle tasks were stalled on CPU"},
+            {"pressure_cpu_full_percentage_window_min",
+             "Minimum percentage of time all non-idle tasks were stalled on CPU sampled in the stats window"},
+            {"pressure_cpu_full_percentage_window_max",
+             "Maximum percentage of time all non-idle tasks were stalled on CPU sampled in the stats window"},
+            {"pressure_cpu_full_percentage_window",
+             "Percentage of time all non-idle tasks were stalled on CPU sampled since startup, quantiles over the "
+             "stats window"},
+            {"pressure_cpu_full_percentage_window_sample_sum",
+             "Sum of the CPU full pressure percentages sampled in the stats window"},
+            {"pressure_cpu_full_percentage_window_samples", "CPU full pressure samples in the stats window"},
+        },
+    [STREAM_PRESSURE_IO_SOME] =
+        {
+            {"pressure_io_some_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time some tasks were stalled on I/O"},
+            {"pressure_io_some_percentage_window_min",
+             "Minimum percentage of time some tasks were stalled on I/O sampled in the stats window"},
+            {"pressure_io_some_percentage_window_max",
+             "Maximum percentage of time some tasks were stalled on I/O sampled in the stats window"},
+            {"pressure_io_some_percentage_window",
+             "Percentage of time some tasks were stalled on I/O sampled since startup, quantiles over the stats "
+             "window"},
+            {"pressure_io_some_percentage_window_sample_sum",
+             "Sum of the I/O some pressure percentages sampled in the stats window"},
+            {"pressure_io_some_percentage_window_samples", "I/O some pressure samples in the stats window"},
+        },
+    [STREAM_PRESSURE_IO_FULL] =
+        {
+            {"pressure_io_full_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time all non-idle tasks were stalled on I/O"},
+            {"pressure_io_full_percentage_window_min",
+             "Minimum percentage of time all non-idle tasks were stalled on I/O sampled in the stats window"},
+            {"pressure_io_full_percentage_window_max",
+             "Maximum percentage of time all non-idle tasks were stalled on I/O sampled in the stats window"},
+            {"pressure_io_full_percentage_window",
+             "Percentage of time all non-idle tasks were stalled on I/O sampled since startup, quantiles over the "
+             "stats window"},
+            {"pressure_io_full_percentage_window_sample_sum",
+             "Sum of the I/O full pressure percentages sampled in the stats window"},
+            {"pressure_io_full_percentage_window_samples", "I/O full pressure samples in the stats window"},
+        },
+    [STREAM_PRESSURE_MEMORY_SOME] =
+        {
+            {"pressure_memory_some_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time some tasks were stalled on memory"},
+            {"pressure_memory_some_percentage_window_min",
+             "Minimum percentage of time some tasks were stalled on memory sampled in the stats window"},
+            {"pressure_memory_some_percentage_window_max",
+             "Maximum percentage of time some tasks were stalled on memory sampled in the stats window"},
+            {"pressure_memory_some_percentage_window",
+             "Percentage of time some tasks were stalled on memory sampled since startup, quantiles over the stats "
+             "window"},
+            {"pressure_memory_some_percentage_window_sample_sum",
+             "Sum of the memory some pressure percentages sampled in the stats window"},
+            {"pressure_memory_some_percentage_window_samples", "Memory some pressure samples in the stats window"},
+        },
+    [STREAM_PRESSURE_MEMORY_FULL] =
+        {
+            {"pressure_memory_full_percentage_ewma",
+             "Exponentially weighted moving average of the percentage of time all non-idle tasks were stalled on "
+             "memory"},
+            {"pressure_memory_full_percentage_window_min",
+             "Minimum percentage of time all non-idle tasks were stalled on memory sampled in the stats window"},
+            {"pressure_memory_full_percentage_window_max",
+             "Maximum percentage of time all non-idle tasks were stalled on memory sampled in the stats window"},
+            {"pressure_memory_full_percentage_window",
+             "Percentage of time all non-idle tasks were stalled on memory sampled since startup, quantiles over the "
+             "stats window"},
+            {"pressure_memory_full_percentage_window_sample_sum",
+             "Sum of the memory full pressure percentages sampled in the stats window"},
+            {"pressure_memory_full_percentage_window_samples", "Memory full pressure samples in the stats window"},
+        },
+};
+
+/** Cuantiles exportados en cada summary */
+static const double quantiles[] = {0.5, 0.9, 0.99};
+
+/** Etiquetas de los cuantiles, en el orden de quantiles */
+static const char* const quantile_labels[] = {"quantile=\"0.5\"", "quantile=\"0.9\"", "quantile=\"0.99\""};
+
+/** Cantidad de cuantiles */
+#define QUANTILE_COUNT (sizeof(quantiles) / sizeof(quantiles[0]))
+
+/** Identificadores de las familias en el registro */
+static int families[STREAM_SERIES_COUNT][FAMILY_COUNT];
+
+/** Estadísticas de cada serie, protegidas por stats_lock */
+static stream_stats_t stream_stats[STREAM_SERIES_COUNT];
+
+/**
+ * Suma y cantidad de todas las muestras desde el arranque, para el _sum y el _count de cada
+ * summary; a diferencia de la ventana, no decrecen ni se reinician al cambiar la configuración.
+ * Protegidas por stats_lock
+ */
+static double total_sums[STREAM_SERIES_COUNT];
+static uint64_t total_counts[STREAM_SERIES_COUNT];
+
+/** Protege stream_stats entre el hilo de muestreo y los scrapes */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int init_stream_stats()
+{
+    for (int s = 0; s < STREAM_SERIES_COUNT; s++)
+    {
+        for (int f = 0; f < FAMILY_COUNT; f++)
+        {
+            bool window = f == FAMILY_WINDOW;
+            families[s][f] = registry_add_family(family_defs[s][f][0], family_defs[s][f][1],
+                                                 window ? METRIC_TYPE_SUMMARY : METRIC_TYPE_GAUGE,
+                                                 METRIC_GROUP_STREAM_STATS, window ? QUANTILE_COUNT + 2 : 1);
+            if (families[s][f] < 0)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+
+        // Summary: una serie por cuantil de la ventana, seguidas de _sum y _count acumulados
+        int window = families[s][FAMILY_WINDOW];
+        for (size_t q = 0; q < QUANTILE_COUNT; q++)
+        {
+            registry_set_labels(window, q, quantile_labels[q]);
+        }
+        registry_set_suffix(window, QUANTILE_COUNT, "_sum");
+        registry_set_suffix(window, QUANTILE_COUNT + 1, "_count");
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void publish_stream_stats()
+{
+    double values[QUANTILE_COUNT];
+    stats_summary_t summary;
+    int64_t now = platform_now_ns();
+
+    pthread_mutex_lock(&stats_lock);
+    for (int s = 0; s < STREAM_SERIES_COUNT; s++)
+    {
+        // Las series que nunca se muestrearon (p. ej. PSI en un kernel sin soporte) no se exponen
+        bool sampled = total_counts[s] > 0;
+        for (int f = 0; f < FAMILY_COUNT; f++)
+        {
+            registry_set_active_series(families[s][f], sampled ? (f == FAMILY_WINDOW ? QUANTILE_COUNT + 2 : 1) : 0);
+        }
+
+        stats_summarize(&stream_stats[s], now, quantiles, QUANTILE_COUNT, values, &summary);
+
+        registry_set(families[s][FAMILY_EWMA], 0, summary.ewma);
+        registry_set(families[s][FAMILY_MIN], 0, summary.min);
+        registry_set(families[s][FAMILY_MAX], 0, summary.max);
+        for (size_t q = 0; q < QUANTILE_COUNT; q++)
+        {
+            registry_set(families[s][FAMILY_WINDOW], q, values[q]);
+        }
+        registry_set(families[s][FAMILY_WINDOW], QUANTILE_COUNT, total_sums[s]);
+        registry_set(families[s][FAMILY_WINDOW], QUANTILE_COUNT + 1, (double)total_counts[s]);
+        registry_set(families[s][FAMILY_WINDOW_SUM], 0, summary.sum);
+        registry_set(families[s][FAMILY_WINDOW_SAMPLES], 0, (double)summary.count);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * @brief Reinicia las estadísticas de todas las series para un nuevo muestreo o ventana.
+ */
+static void reset_stream_stats(int sample_ms, int cpu_ms, int window_s)
+{
+    pthread_mutex_lock(&stats_lock);
+    for (int s = 0; s < STREAM_SERIES_COUNT; s++)
+    {
+        stats_init(&stream_stats[s], window_s, (s == STREAM_CPU ? cpu_ms : sample_ms) / 1000.0);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/**
+ * @brief Período de muestreo de la CPU: el configurado, o el que junta SAMPLER_CPU_MIN_JIFFIES.
+ *
+ * @param sample_ms Período de muestreo configurado, en milisegundos.
+ * @return Período de muestreo de la CPU, en milisegundos.
+ */
+static int cpu_sample_ms(int sample_ms)
+{
+    long jiffies_per_s = sysconf(_SC_CLK_TCK) * platform_cpu_count(); // Sumados en todas las CPUs
+    if (jiffies_per_s <= 0)
+    {
+        jiffies_per_s = 100;
+    }
+
+    int cpu_ms = (int)((SAMPLER_CPU_MIN_JIFFIES * 1000 + jiffies_per_s - 1) / jiffies_per_s);
+    return cpu_ms > sample_ms ? cpu_ms : sample_ms;
+}
+
+/**
+ * @brief Porcentaje del tiempo transcurrido entre dos lecturas de PSI que hubo demora.
+ */
+static double pressure_percentage(unsigned long long prev_us, unsigned long long cur_us, int64_t elapsed_ns)
+{
+    double percentage = (double)(cur_us - prev_us) * 1000.0 / elapsed_ns * 100.0;
+
+    return percentage > 100.0 ? 100.0 : percentage; // Las lecturas no son atómicas con el reloj
+}
+
+/**
+ * @brief Agrega una muestra a la ventana y a los totales de una serie; requiere stats_lock.
+ */
+static void add_sample(int series, double value, int64_t now)
+{
+    stats_add(&stream_stats[series], value, now);
+    total_sums[series] += value;
+    total_counts[series]++;
+}
+
+void* sample_metrics(void* arg)
+{
+    (void)arg; // Unused argument
+
+    cpu_times_t prev_cpu;
+    bool has_prev_cpu = false;
+    int64_t next_cpu_ns = 0;
+    unsigned long long prev_pressure[PRESSURE_RESOURCE_COUNT][2];
+    int prev_pressure_lines[PRESSURE_RESOURCE_COUNT] = {0};
+    int64_t prev_pressure_ns[PRESSURE_RESOURCE_COUNT];
+    int sample_ms = 0, cpu_ms = 0, window_s = 0;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (1)
+    {
+        const monitor_config_t* config = config_acquire();
+        bool enabled = config->enabled[METRIC_GROUP_STREAM_STATS];
+        bool changed = config->stats_sample_ms != sample_ms || config->stats_window_s != window_s;
+        sample_ms = config->stats_sample_ms;
+        window_s = config->stats_window_s;
+        config_release(config);
+
+        if (!enabled)
+        {
+            has_prev_cpu = false;
+            memset(prev_pressure_lines, 0, sizeof(prev_pressure_lines));
+            sample_ms = 0; // Reiniciar las estadísticas al volver a habilitarse
+            sleep(1);
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            continue;
+        }
+        if (changed)
+        {
+            cpu_ms = cpu_sample_ms(sample_ms);
+            reset_stream_stats(sample_ms, cpu_ms, window_s);
+        }
+
+        double values[STREAM_SERIES_COUNT];
+        for (int s = 0; s < STREAM_SERIES_COUNT; s++)
+        {
+            values[s] = -1.0; // Sin muestra en este instante
+        }
+        metrics_tick_reset();
+
+        // La CPU se muestrea cada cpu_ms, sin los mensajes de error de get_cpu_usage(): si no
+        // transcurrió ningún jiffy la muestra se descarta y la referencia se conserva
+        int64_t now = platform_now_ns();
+        cpu_times_t cpu;
+        if (now >= next_cpu_ns && get_cpu_times(&cpu) == 0)
+        {
+            values[STREAM_CPU] = has_prev_cpu ? cpu_usage_between(&prev_cpu, &cpu) : -1.0;
+            if (!has_prev_cpu || values[STREAM_CPU] >= 0)
+            {
+                prev_cpu = cpu;
+                has_prev_cpu = true;
+                next_cpu_ns = now + (int64_t)cpu_ms * 1000000;
+            }
+        }
+
+        values[STREAM_MEMORY] = get_memory_usage();
+
+        // PSI acumula microsegundos de demora; cada muestra es la fracción del intervalo demorada
+        for (size_t r = 0; r < PRESSURE_RESOURCE_COUNT; r++)
+        {
+            unsigned long long totals[2];
+            int lines = get_pressure_totals(pressure_resources[r], totals);
+            int64_t read_ns = platform_now_ns();
+
+            for (int line = 0; line < lines && line < prev_pressure_lines[r] && read_ns > prev_pressure_ns[r]; line++)
+            {
+                values[STREAM_PRESSURE_CPU_SOME + 2 * r + line] =
+                    pressure_percentage(prev_pressure[r][line], totals[line], read_ns - prev_pressure_ns[r]);
+            }
+            memcpy(prev_pressure[r], totals, sizeof(totals));
+            prev_pressure_lines[r] = lines > 0 ? lines : 0;
+            prev_pressure_ns[r] = read_ns;
+        }
+        now = platform_now_ns();
+
+        pthread_mutex_lock(&stats_lock);
+        for (int s = 0; s < STREAM_SERIES_COUNT; s++)
+        {
+            if (values[s] >= 0)
+            {
+                add_sample(s, values[s], now);
+            }
+        }
+        pthread_mutex_unlock(&stats_lock);
+
+        // Esperar hasta el próximo instante de muestreo; si hay atraso, no recuperarlo en ráfaga
+        int64_t next = (int64_t)deadline.tv_sec * 1000000000 + deadline.tv_nsec + (int64_t)sample_ms * 1000000;
+        if (next < now)
+        {
+            next = now;
+        }
+        deadline.tv_sec = next / 1000000000;
+        deadline.tv_nsec = next % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,317 @@
+#include "../include/schedstat.h"
+#include "../include/metrics.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** Tamaño del buffer de getdents64() al recorrer /proc */
+#define DIRENT_BUFFER_SIZE 32768
+
+/**
+ * Lectura anterior de una CPU, alineada a una línea de caché para que la recolección de
+ * distintas CPUs en paralelo no comparta líneas entre hilos
+ */
+typedef struct
+{
+    _Alignas(64) unsigned long long run_delay_ns;
+    unsigned long long timeslices;
+    int64_t at_ns;
+    bool has_prev;
+} cpu_state_t;
+
+/** Estado de cada CPU */
+static cpu_state_t cpu_states[PLATFORM_MAX_CPUS];
+
+/** Lectura de /proc/[pid]/schedstat de un proceso */
+typedef struct
+{
+    pid_t pid;
+    unsigned long long run_delay_ns;
+    unsigned long long timeslices;
+} task_sample_t;
+
+/** Lecturas de la recorrida anterior y de la actual, ordenadas por pid; se alternan */
+static task_sample_t task_samples[2][SCHEDSTAT_MAX_TASKS];
+
+/** Cantidad de lecturas de cada recorrida */
+static int task_counts[2];
+
+/** Índice en task_samples de la recorrida anterior */
+static int previous_scan;
+
+/** Instante (CLOCK_MONOTONIC, en nanosegundos) de la recorrida anterior; 0 si no hubo */
+static int64_t previous_scan_ns;
+
+/** Entrada de getdents64() */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+bool schedstat_available()
+{
+    return access("/proc/schedstat", R_OK) == 0;
+}
+
+/**
+ * @brief Parsea una línea "cpuN ..." de /proc/schedstat.
+ *
+ * Según la versión del formato la línea tiene 9 campos (versión 15 en adelante) o más,
+ * pero en todas el run delay y los timeslices son los dos últimos.
+ *
+ * @return false si la línea no tiene al menos esos dos campos.
+ */
+static bool parse_cpu_line(const char* line, int* cpu, unsigned long long* run_delay_ns,
+                           unsigned long long* timeslices)
+{
+    char* end;
+    *cpu = (int)strtol(line + strlen("cpu"), &end, 10);
+    if (end == line + strlen("cpu"))
+    {
+        return false;
+    }
+
+    unsigned long long fields[2] = {0, 0};
+    int count = 0;
+    const char* cursor = end;
+    while (1)
+    {
+        unsigned long long value = strtoull(cursor, &end, 10);
+        if (end == cursor)
+        {
+            break;
+        }
+        fields[0] = fields[1];
+        fields[1] = value;
+        count++;
+        cursor = end;
+    }
+
+    *run_delay_ns = fields[0];
+    *timeslices = fields[1];
+    return count >= 2;
+}
+
+int schedstat_read_cpus(schedstat_rates_t rates[PLATFORM_MAX_CPUS])
+{
+    char* cursor = read_proc_file("/proc/schedstat");
+    if (cursor == NULL)
+    {
+        fprintf(stderr, "Error reading /proc/schedstat\n");
+        return -1;
+    }
+
+    memset(rates, 0, PLATFORM_MAX_CPUS * sizeof(rates[0]));
+    int64_t now = platform_now_ns();
+    int parsed = 0;
+
+    while (*cursor != '\0')
+    {
+        char* line = cursor;
+        char* end = strchr(line, '\n');
+        cursor = end != NULL ? end + 1 : line + strlen(line);
+        if (end != NULL)
+        {
+            *end = '\0';
+        }
+
+        int cpu;
+        unsigned long long run_delay_ns, timeslices;
+        if (strncmp(line, "cpu", 3) != 0 || !parse_cpu_line(line, &cpu, &run_delay_ns, &timeslices) || cpu < 0 ||
+            cpu >= PLATFORM_MAX_CPUS)
+        {
+            continue; // version, timestamp, las líneas de dominios y las CPUs no monitoreadas (ver platform.h)
+        }
+
+        cpu_state_t* state = &cpu_states[cpu];
+        if (state->has_prev && now > state->at_ns && run_delay_ns >= state->run_delay_ns &&
+            timeslices >= state->timeslices)
+        {
+            double seconds = (now - state->at_ns) / 1e9;
+            rates[cpu].run_delay = (run_delay_ns - state->run_delay_ns) / 1e9 / seconds;
+            rates[cpu].timeslices = (timeslices - state->timeslices) / seconds;
+        }
+        state->run_delay_ns = run_delay_ns;
+        state->timeslices = timeslices;
+        state->at_ns = now;
+        state->has_prev = true;
+        parsed++;
+    }
+
+    if (parsed == 0)
+    {
+        fprintf(stderr, "Error parsing /proc/schedstat\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Lee un archivo chico de /proc en @p buffer, sin pasar por la arena del ciclo.
+ *
+ * @return Bytes leídos, o -1 si el proceso ya no existe.
+ */
+static ssize_t read_small_file(const char* path, char* buffer, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+    if (length >= 0)
+    {
+        buffer[length] = '\0';
+    }
+
+    return length;
+}
+
+/**
+ * @brief Busca la lectura anterior de un proceso.
+ *
+ * @return Lectura anterior, o NULL si el proceso no estaba en la recorrida anterior.
+ */
+static const task_sample_t* find_previous(pid_t pid)
+{
+    const task_sample_t* samples = task_samples[previous_scan];
+    int low = 0, high = task_counts[previous_scan] - 1;
+
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        if (samples[middle].pid == pid)
+        {
+            return &samples[middle];
+        }
+        if (samples[middle].pid < pid)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Inserta un proceso en el top, ordenado de mayor a menor run delay.
+ */
+static void insert_top(schedstat_task_t* top, int max, int* count, pid_t pid, const schedstat_rates_t* rates)
+{
+    int position = *count < max ? *count : max;
+    while (position > 0 && top[position - 1].rates.run_delay < rates->run_delay)
+    {
+        if (position < max)
+        {
+            top[position] = top[position - 1];
+        }
+        position--;
+    }
+    if (position == max)
+    {
+        return; // Espera menos que todos los del top
+    }
+
+    top[position].pid = pid;
+    top[position].rates = *rates;
+    if (*count < max)
+    {
+        (*count)++;
+    }
+}
+
+int schedstat_top_tasks(schedstat_task_t* top, int max)
+{
+    int dir = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0)
+    {
+        perror("Error opening /proc");
+        return -1;
+    }
+
+    static char entries[DIRENT_BUFFER_SIZE];
+    int scan = 1 - previous_scan;
+    task_sample_t* samples = task_samples[scan];
+    int sampled = 0, count = 0;
+    int64_t now = platform_now_ns();
+    double seconds = previous_scan_ns > 0 ? (now - previous_scan_ns) / 1e9 : 0;
+    long length;
+
+    while ((length = syscall(SYS_getdents64, dir, entries, sizeof(entries))) > 0)
+    {
+        for (long offset = 0; offset < length;)
+        {
+            const struct linux_dirent64* entry = (const struct linux_dirent64*)(entries + offset);
+            offset += entry->d_reclen;
+
+            char* end;
+            long pid = strtol(entry->d_name, &end, 10);
+            if (*end != '\0' || pid <= 0 || sampled == SCHEDSTAT_MAX_TASKS ||
+                (sampled > 0 && pid <= samples[sampled - 1].pid))
+            {
+                continue; // No es un proceso, no hay lugar, o llegó fuera de orden y rompería la búsqueda
+            }
+
+            char path[48], content[96];
+            unsigned long long run_time_ns, run_delay_ns, timeslices;
+            snprintf(path, sizeof(path), "/proc/%ld/schedstat", pid);
+            if (read_small_file(path, content, sizeof(content)) <= 0 ||
+                sscanf(content, "%llu %llu %llu", &run_time_ns, &run_delay_ns, &timeslices) != 3)
+            {
+                continue; // El proceso terminó durante la recorrida
+            }
+
+            task_sample_t* sample = &samples[sampled++];
+            sample->pid = (pid_t)pid;
+            sample->run_delay_ns = run_delay_ns;
+            sample->timeslices = timeslices;
+
+            const task_sample_t* previous = find_previous(sample->pid);
+            if (previous != NULL && seconds > 0 && run_delay_ns >= previous->run_delay_ns &&
+                timeslices >= previous->timeslices)
+            {
+                schedstat_rates_t rates = {(run_delay_ns - previous->run_delay_ns) / 1e9 / seconds,
+                                           (timeslices - previous->timeslices) / seconds};
+                insert_top(top, max, &count, sample->pid, &rates);
+            }
+        }
+    }
+    close(dir);
+
+    task_counts[scan] = sampled;
+    previous_scan = scan;
+    previous_scan_ns = now;
+
+    // El nombre sólo se lee para los procesos del top
+    for (int i = 0; i < count; i++)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/comm", (int)top[i].pid);
+        ssize_t n = read_small_file(path, top[i].comm, sizeof(top[i].comm));
+        if (n <= 0)
+        {
+            top[i].comm[0] = '\0';
+        }
+        else if (top[i].comm[n - 1] == '\n')
+        {
+            top[i].comm[n - 1] = '\0';
+        }
+    }
+
+    return count;
+}
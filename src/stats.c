@@ -0,0 +1,171 @@
+#include "../include/stats.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+/** Marca de un intervalo que todavía no recibió muestras */
+#define BUCKET_UNUSED INT64_MIN
+
+/** Base de los bins logarítmicos: cada bin cubre [gamma^(k-1), gamma^k) */
+static const double gamma_base = (1 + SKETCH_RELATIVE_ACCURACY) / (1 - SKETCH_RELATIVE_ACCURACY);
+
+/**
+ * @brief Índice del bin correspondiente a @p value (mayor o igual que SKETCH_MIN_VALUE).
+ */
+static int bin_index(double value)
+{
+    static double log_gamma = 0;
+    static int min_key = 0;
+
+    if (log_gamma == 0)
+    {
+        log_gamma = log(gamma_base);
+        min_key = (int)ceil(log(SKETCH_MIN_VALUE) / log_gamma);
+    }
+
+    int index = (int)ceil(log(value) / log_gamma) - min_key;
+    if (index < 0)
+    {
+        return 0;
+    }
+    return index < SKETCH_BINS ? index : SKETCH_BINS - 1;
+}
+
+/**
+ * @brief Valor representativo de un bin, con error relativo acotado por SKETCH_RELATIVE_ACCURACY.
+ */
+static double bin_value(int index)
+{
+    int min_key = (int)ceil(log(SKETCH_MIN_VALUE) / log(gamma_base));
+    return 2 * pow(gamma_base, index + min_key) / (gamma_base + 1);
+}
+
+/**
+ * @brief Vacía un intervalo y lo marca como comenzado en @p start_ns.
+ */
+static void reset_bucket(stats_bucket_t* bucket, int64_t start_ns)
+{
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->start_ns = start_ns;
+}
+
+void stats_init(stream_stats_t* stats, double window_s, double sample_s)
+{
+    stats->ewma = 0;
+    stats->has_ewma = 0;
+    stats->alpha = 1 - exp(-sample_s / window_s);
+    stats->current = 0;
+    stats->bucket_ns = (int64_t)(window_s * 1e9 / STATS_WINDOW_BUCKETS);
+
+    for (int i = 0; i < STATS_WINDOW_BUCKETS; i++)
+    {
+        reset_bucket(&stats->buckets[i], BUCKET_UNUSED);
+    }
+}
+
+void stats_add(stream_stats_t* stats, double value, int64_t now_ns)
+{
+    stats_bucket_t* bucket = &stats->buckets[stats->current];
+
+    if (value < 0)
+    {
+        value = 0;
+    }
+
+    if (bucket->start_ns == BUCKET_UNUSED)
+    {
+        bucket->start_ns = now_ns;
+    }
+    else if (now_ns - bucket->start_ns >= stats->bucket_ns)
+    {
+        // Pasar al intervalo siguiente; los intervalos sin muestras quedan fuera de la ventana por su antigüedad
+        int64_t elapsed = (now_ns - bucket->start_ns) / stats->bucket_ns;
+        int64_t start_ns = bucket->start_ns + elapsed * stats->bucket_ns;
+
+        stats->current = (stats->current + 1) % STATS_WINDOW_BUCKETS;
+        bucket = &stats->buckets[stats->current];
+        reset_bucket(bucket, start_ns);
+    }
+
+    if (bucket->count == 0 || value < bucket->min)
+    {
+        bucket->min = value;
+    }
+    if (bucket->count == 0 || value > bucket->max)
+    {
+        bucket->max = value;
+    }
+    bucket->count++;
+    bucket->sum += value;
+
+    if (value < SKETCH_MIN_VALUE)
+    {
+        bucket->zero_count++;
+    }
+    else
+    {
+        bucket->bins[bin_index(value)]++;
+    }
+
+    stats->ewma = stats->has_ewma ? stats->ewma + stats->alpha * (value - stats->ewma) : value;
+    stats->has_ewma = 1;
+}
+
+void stats_summarize(const stream_stats_t* stats, int64_t now_ns, const double* quantiles, size_t count,
+                     double* values, stats_summary_t* summary)
+{
+    const int64_t window_ns = stats->bucket_ns * STATS_WINDOW_BUCKETS;
+    bool live[STATS_WINDOW_BUCKETS];
+    uint64_t zero_count = 0;
+
+    summary->ewma = stats->ewma;
+    summary->sum = 0;
+    summary->count = 0;
+    summary->min = INFINITY;
+    summary->max = -INFINITY;
+
+    for (int i = 0; i < STATS_WINDOW_BUCKETS; i++)
+    {
+        const stats_bucket_t* bucket = &stats->buckets[i];
+
+        live[i] = bucket->start_ns != BUCKET_UNUSED && bucket->count > 0 && now_ns - bucket->start_ns < window_ns;
+        if (!live[i])
+        {
+            continue;
+        }
+
+        summary->sum += bucket->sum;
+        summary->count += bucket->count;
+        summary->min = fmin(summary->min, bucket->min);
+        summary->max = fmax(summary->max, bucket->max);
+        zero_count += bucket->zero_count;
+    }
+
+    if (summary->count == 0)
+    {
+        summary->min = 0;
+        summary->max = 0;
+        memset(values, 0, count * sizeof(*values));
+        return;
+    }
+
+    for (size_t q = 0; q < count; q++)
+    {
+        // Recorrer los bins combinados hasta superar el rango del cuantil
+        double rank = quantiles[q] * (summary->count - 1);
+        uint64_t seen = zero_count;
+        int index = -1;
+
+        for (int bin = 0; bin < SKETCH_BINS && seen <= rank; bin++)
+        {
+            for (int i = 0; i < STATS_WINDOW_BUCKETS; i++)
+            {
+                seen += live[i] ? stats->buckets[i].bins[bin] : 0;
+            }
+            index = bin;
+        }
+
+        double value = index < 0 ? 0 : bin_value(index);
+        values[q] = fmin(fmax(value, summary->min), summary->max);
+    }
+}